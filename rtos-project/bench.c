@@ -0,0 +1,381 @@
+// Nicholas Nhat Tran
+// 1002027150
+
+// IPC round-trip benchmark and checks
+//
+// Pong is a message server, every exercise is a request to it. pingpong
+// posts benchStart: Ping and Pong bounce a pair of semaphores BENCH_ROUNDS
+// times, first with separate post and wait calls and then with postAndWait,
+// and Ping prints the cycles per round trip. ipccheck posts benchCheck:
+// Ping runs one check per ipc service and prints ok or FAILED for each.
+// Both run privileged so they can read the cycle counter and the trace.
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tm4c123gh6pm.h"
+#include "kernel.h"
+#include "uart0.h"
+#include "util.h"
+#include "workqueue.h"
+#include "bench.h"
+
+//-----------------------------------------------------------------------------
+// Benchmark Variables
+//-----------------------------------------------------------------------------
+
+handle benchPing;
+handle benchPong;
+uint8_t benchServer;    // pong's task index, the target of every request
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// creates the semaphores and tasks, call before startRtos
+bool initBench(void)
+{
+    bool ok;
+    benchStart = createSemaphoreKernel(0);
+    ok = (benchStart != INVALID_HANDLE);
+    benchCheck = createSemaphoreKernel(0);
+    ok &= (benchCheck != INVALID_HANDLE);
+    benchPing = createSemaphoreKernel(0);
+    ok &= (benchPing != INVALID_HANDLE);
+    benchPong = createSemaphoreKernel(0);
+    ok &= (benchPong != INVALID_HANDLE);
+    ok &= createThread(pingTask, "Ping", BENCH_PRIORITY, BENCH_STACK);
+    ok &= createThread(pongTask, "Pong", BENCH_PRIORITY, BENCH_STACK);
+    if (ok)
+    {
+        setThreadPrivileged(pingTask, true);
+        setThreadPrivileged(pongTask, true);
+        benchServer = getTaskIndex(pongTask);
+    }
+    return ok;
+}
+
+// sends one request to pong, returns its result or 0 if the send failed
+uint32_t benchRequest(uint8_t op, uint32_t arg)
+{
+    BenchRequest request;
+    request.op = op;
+    request.arg = arg;
+    if (msgSend(benchServer, &request, sizeof(request), sizeof(request))
+            != sizeof(request))
+    {
+        return 0;
+    }
+    return request.arg;
+}
+
+// returns the average cycles per round trip
+uint32_t pingPong(bool compound)
+{
+    uint32_t start;
+    uint32_t i;
+
+    benchRequest(BENCH_PINGPONG, compound);
+    start = DWT_CYCCNT_R;
+    for (i = 0; i < BENCH_ROUNDS; i++)
+    {
+        if (compound)
+        {
+            postAndWait(benchPing, benchPong);
+        }
+        else
+        {
+            post(benchPing);
+            wait(benchPong);
+        }
+    }
+    return (DWT_CYCCNT_R - start) / BENCH_ROUNDS;
+}
+
+void printBenchResult(const char label[], uint32_t cycles)
+{
+    char buffer[12];
+    putsUart0((char*) label);
+    itoa(cycles, buffer);
+    putsUart0(buffer);
+    putsUart0(" cycles (");
+    itoa(cycles / 40, buffer);
+    putsUart0(buffer);
+    putsUart0(" us) per round trip\n");
+}
+
+void printBenchCheck(const char label[], bool ok)
+{
+    putsUart0((char*) label);
+    putsUart0(ok ? "ok\n" : "FAILED\n");
+}
+
+void fillBenchData(uint8_t *data)
+{
+    uint32_t i;
+    for (i = 0; i < BENCH_SIZE; i++)
+    {
+        data[i] = i;
+    }
+}
+
+bool checkBenchData(const uint8_t *data)
+{
+    uint32_t i;
+    if (data == NULL)
+    {
+        return false;
+    }
+    for (i = 0; i < BENCH_SIZE; i++)
+    {
+        if (data[i] != (uint8_t) i)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// a send/receive/reply round trip should cost two switches, ping to pong on
+// the send and back when pong blocks for the next request; the trace is
+// cleared and only switches that change task are counted
+bool checkMessage(void)
+{
+    TraceRecord records[8];
+    uint32_t mask;
+    uint32_t count;
+    uint32_t switches = 0;
+    uint32_t start;
+    uint32_t cycles;
+    uint32_t i;
+    bool ok;
+
+    // the first request leaves pong blocked in msgReceive
+    ok = (benchRequest(BENCH_ECHO, 0) == 1);
+    mask = setTraceMask(1 << TRACE_SWITCH);
+    clearTrace();
+    start = DWT_CYCCNT_R;
+    ok &= (benchRequest(BENCH_ECHO, 41) == 42);
+    cycles = DWT_CYCCNT_R - start;
+    count = readTrace(0, records, 8);
+    setTraceMask(mask);
+    for (i = 0; i < count; i++)
+    {
+        if (records[i].task != records[i].arg)
+        {
+            switches++;
+        }
+    }
+    printBenchResult("send + reply: ", cycles);
+    return ok && switches == 2;
+}
+
+// the buffer moves to pong without a copy, ping can no longer free it and
+// pong checks the data in place and frees it
+bool checkBuffer(void)
+{
+    uint8_t *data = bufferAlloc(BENCH_SIZE);
+    bool ok;
+    if (data == NULL)
+    {
+        return false;
+    }
+    fillBenchData(data);
+    if (!bufferTransfer(data, benchServer))
+    {
+        bufferFree(data);
+        return false;
+    }
+    ok = !bufferFree(data);
+    ok &= (benchRequest(BENCH_BUFFER, (uint32_t) data) == 1);
+    return ok;
+}
+
+// pong only gets the region's base once it has been granted
+bool checkShm(void)
+{
+    handle region = shmCreate("bench", BENCH_SIZE);
+    bool ok;
+    if (region == INVALID_HANDLE)
+    {
+        return false;
+    }
+    fillBenchData(shmBase(region));
+    ok = (benchRequest(BENCH_SHM, region) == 0);
+    ok &= shmGrant(region, benchServer, SHM_READ);
+    ok &= (benchRequest(BENCH_SHM, region) == 1);
+    ok &= shmDelete(region);
+    return ok;
+}
+
+// ping and pong subscribe, each keeps its own place in the same samples
+bool checkTopic(void)
+{
+    handle topic = createTopic(sizeof(uint32_t));
+    uint32_t value;
+    uint32_t sample = 0;
+    bool ok;
+    if (topic == INVALID_HANDLE)
+    {
+        return false;
+    }
+    ok = subscribe(topic);
+    ok &= (benchRequest(BENCH_SUBSCRIBE, topic) == 1);
+    for (value = 1; value <= 3; value++)
+    {
+        ok &= publish(topic, &value);
+    }
+    ok &= (topicRead(topic, &sample, TOPIC_NEXT) == 1 && sample == 1);
+    ok &= (benchRequest(BENCH_LATEST, topic) == 3);
+    ok &= (topicRead(topic, &sample, TOPIC_NEXT) == 1 && sample == 2);
+    unsubscribe(topic);
+    deleteTopic(topic);
+    return ok;
+}
+
+// runs unprivileged on a pool worker, arg is the queue to report to
+void benchJob(uint32_t arg)
+{
+    queueSend(arg, &arg, 0, QUEUE_FOREVER);
+}
+
+// the most urgent message comes out first, then the queue collects one
+// report from each pool job
+bool checkQueue(void)
+{
+    handle queue = createQueue(sizeof(uint32_t));
+    uint32_t value;
+    uint8_t i;
+    bool ok = true;
+    if (queue == INVALID_HANDLE)
+    {
+        return false;
+    }
+    for (i = 3; i > 0; i--)
+    {
+        value = i;
+        ok &= queueSend(queue, &value, i, QUEUE_NOWAIT);
+    }
+    for (i = 1; i <= 3; i++)
+    {
+        ok &= queueReceive(queue, &value, NULL, QUEUE_NOWAIT) && value == i;
+    }
+    for (i = 0; i < BENCH_JOBS; i++)
+    {
+        ok &= submitJob(benchJob, queue, i, QUEUE_NOWAIT);
+    }
+    for (i = 0; i < BENCH_JOBS; i++)
+    {
+        ok &= queueReceive(queue, &value, NULL, BENCH_TIMEOUT)
+                && value == queue;
+    }
+    deleteQueue(queue);
+    return ok;
+}
+
+void runBenchChecks(void)
+{
+    printBenchCheck("message:      ", checkMessage());
+    printBenchCheck("buffer:       ", checkBuffer());
+    printBenchCheck("shm:          ", checkShm());
+    printBenchCheck("topic:        ", checkTopic());
+    printBenchCheck("queue + pool: ", checkQueue());
+}
+
+// benchStart runs the benchmark, benchCheck the checks
+void pingTask(void)
+{
+    handle sources[2];
+    uint32_t separate;
+    uint32_t compound;
+    while (true)
+    {
+        sources[0] = benchStart;
+        sources[1] = benchCheck;
+        if (waitAny(sources, 2) == 0)
+        {
+            separate = pingPong(false);
+            compound = pingPong(true);
+            printBenchResult("post + wait:  ", separate);
+            printBenchResult("postAndWait:  ", compound);
+        }
+        else
+        {
+            runBenchChecks();
+        }
+    }
+}
+
+// waits and posts BENCH_ROUNDS times each, so it ends with ping's last wait
+void pongBounce(bool compound)
+{
+    uint32_t i;
+    wait(benchPing);
+    for (i = 1; i < BENCH_ROUNDS; i++)
+    {
+        if (compound)
+        {
+            postAndWait(benchPong, benchPing);
+        }
+        else
+        {
+            post(benchPong);
+            wait(benchPing);
+        }
+    }
+    post(benchPong);
+}
+
+void pongTask(void)
+{
+    BenchRequest request;
+    uint8_t length;
+    int8_t client;
+    uint32_t sample;
+    while (true)
+    {
+        length = sizeof(request);
+        client = msgReceive(&request, &length);
+        if (client < 0)
+        {
+            continue;
+        }
+        switch (request.op)
+        {
+        case BENCH_ECHO:
+            request.arg++;
+            break;
+        case BENCH_BUFFER:
+            request.arg = checkBenchData((uint8_t*) request.arg)
+                    && bufferFree((void*) request.arg);
+            break;
+        case BENCH_SHM:
+            request.arg = checkBenchData(shmBase(request.arg));
+            break;
+        case BENCH_SUBSCRIBE:
+            request.arg = subscribe(request.arg);
+            break;
+        case BENCH_LATEST:
+            sample = 0;
+            topicRead(request.arg, &sample, TOPIC_LATEST | TOPIC_NOWAIT);
+            unsubscribe(request.arg);
+            request.arg = sample;
+            break;
+        }
+        msgReply(client, &request, sizeof(request));
+        if (request.op == BENCH_PINGPONG)
+        {
+            pongBounce(request.arg);
+        }
+    }
+}
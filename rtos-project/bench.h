@@ -0,0 +1,53 @@
+// Nicholas Nhat Tran
+// 1002027150
+
+// IPC round-trip benchmark
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//-----------------------------------------------------------------------------
+// Benchmark Defines
+//-----------------------------------------------------------------------------
+
+#define BENCH_ROUNDS   1000
+#define BENCH_PRIORITY 1    // above the other tasks so nothing runs in between
+#define BENCH_STACK    1024
+#define BENCH_SIZE     256  // bytes in the handed over buffer and region
+#define BENCH_JOBS     4    // jobs given to the worker pool
+#define BENCH_TIMEOUT  1000 // ms to wait for each pool job
+
+// requests pong serves, ping sends each as a message and pong answers with
+// the same request, arg replaced by the result
+#define BENCH_PINGPONG  0   // bounce the semaphores, arg selects postAndWait
+#define BENCH_ECHO      1   // returns arg + 1
+#define BENCH_BUFFER    2   // checks and frees the buffer at arg
+#define BENCH_SHM       3   // checks region arg, 0 if it was not granted
+#define BENCH_SUBSCRIBE 4   // subscribes to topic arg
+#define BENCH_LATEST    5   // reads the newest sample of topic arg, unsubscribes
+
+typedef struct _bench_request
+{
+    uint8_t op;
+    uint32_t arg;           // mode, value, handle or address
+} BenchRequest;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+bool initBench(void);
+void pingTask(void);
+void pongTask(void);
+
+#endif
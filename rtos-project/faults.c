@@ -23,6 +23,15 @@
 #include "kernel.h"
 #include "stackHelper.h"
 #include "util.h"
+#include "trace.h"
+#include "workqueue.h"
+
+//-----------------------------------------------------------------------------
+// Fault Variables
+//-----------------------------------------------------------------------------
+
+FaultRecord mpuFault;
+bool mpuFaultPending = false;
 
 
 //-----------------------------------------------------------------------------
@@ -38,25 +47,47 @@ void threadSafeExit(void)
 // REQUIRED: If these were written in assembly
 //           omit this file and add a faults.s file
 
-// REQUIRED: code this function
-void mpuFaultIsr(void)
+// prints the diagnostics captured by mpuFaultIsr, runs on the work queue
+// arg is the pid of the faulting task, the running task is the worker
+void printMpuFault(uint32_t arg)
 {
     putsUart0("--- FAULT DIAGNOSTICS ---\n");
     putsUart0("MPU fault in process ");
-    printPid(1);
+    printTaskPid(arg, 1);
     putsUart0("\n");
 
     uint32_t debugFlags = PRINT_STACK_POINTERS | PRINT_MFAULT_FLAGS
             | PRINT_OFFENDING_INSTRUCTION | PRINT_STACK_DUMP
             | PRINT_DATA_ADDRESSES;
-    printFaultDebug(debugFlags);
+    printFaultRecord(&mpuFault, debugFlags);
+    mpuFaultPending = false;
+
+    putsUart0("\n> ");
+}
+
+// REQUIRED: code this function
+// the blocking uart output is deferred to the work queue, so the handler
+// only captures state, kills the task and returns
+void mpuFaultIsr(void)
+{
+    // faults are above the basepri threshold, but they are synchronous to
+    // unprivileged task code so they never land inside a critical section
+    traceRecord(TRACE_ISR, getTaskCurrent(), 4);
+
+    // a fault arriving before the last one was printed is not reported
+    if (!mpuFaultPending)
+    {
+        captureFault(&mpuFault);
+        mpuFaultPending = queueWorkFromIsr(printMpuFault,
+                                           getTaskPid(getTaskCurrent()),
+                                           WORK_LANE_HIGH);
+    }
 
     forceKillThread(getTaskCurrent());
 
     NVIC_FAULT_STAT_R = (NVIC_FAULT_STAT_DERR | NVIC_FAULT_STAT_IERR);
     triggerPendSvFault();
 
-    putsUart0("\n> ");
     uint32_t *psp = getPsp();
     psp[6] = (uint32_t)threadSafeExit;
 
@@ -146,19 +177,43 @@ void triggerUsageFault()
     volatile int z = x / y; // This will now trigger a usage fault.
 }
 
+// snapshot of the fault state, taken in the fault handler so it can be
+// printed later from thread context
+void captureFault(FaultRecord *record)
+{
+    int i;
+    uint32_t *psp = getPsp();
+
+    record->msp = (uint32_t) getMsp();
+    record->psp = (uint32_t) psp;
+    for (i = 0; i < 8; i++)
+    {
+        record->frame[i] = psp[i];
+    }
+    record->faultStat = NVIC_FAULT_STAT_R;
+    record->mmAddr = NVIC_MM_ADDR_R;
+    record->instruction = *(uint32_t*) psp[6];
+}
+
 void printFaultDebug(uint32_t flags)
 {
-    uint32_t *currentPsp = getPsp();
-    uint32_t *currentMsp = getMsp();
+    FaultRecord record;
+    captureFault(&record);
+    printFaultRecord(&record, flags);
+}
+
+void printFaultRecord(const FaultRecord *record, uint32_t flags)
+{
+    const uint32_t *currentPsp = record->frame;
 
     // Print PSP and MSP addresses
     if (flags & PRINT_STACK_POINTERS)
     {
         char mspStr[12];
-        itoh((uint32_t) currentMsp, mspStr);
+        itoh(record->msp, mspStr);
 
         char pspStr[12];
-        itoh((uint32_t) currentPsp, pspStr);
+        itoh(record->psp, pspStr);
 
         putsUart0("--- STACK POINTERS ---\n");
         putsUart0("MSP    (Main Stack Pointer):\t");
@@ -219,7 +274,7 @@ void printFaultDebug(uint32_t flags)
     // Print mfault flags (in hex)
     if (flags & PRINT_MFAULT_FLAGS)
     {
-        uint32_t faultStat = NVIC_FAULT_STAT_R;
+        uint32_t faultStat = record->faultStat;
         putsUart0("--- FAULT STATUS REGISTERS ---\n");
         putsUart0("Indicated causes of fault(s) in FAULTSTAT register:\n");
         if (faultStat & NVIC_FAULT_STAT_DIV0)
@@ -312,8 +367,7 @@ void printFaultDebug(uint32_t flags)
     {
         // print offending instruction
         putsUart0("--- OFFENDING INSTRUCTION ---\n");
-        uint32_t *faultingPc = (uint32_t*) currentPsp[6];
-        uint32_t rawInstruction = *faultingPc;
+        uint32_t rawInstruction = record->instruction;
         uint32_t ntohsInstruction = (rawInstruction << 16)
                 | (rawInstruction >> 16);
 
@@ -330,9 +384,9 @@ void printFaultDebug(uint32_t flags)
         putsUart0("--- DATA ADDRESSES ---\n");
 
         // Check if the MMFAR contains a valid address
-        if (NVIC_FAULT_STAT_R & NVIC_FAULT_STAT_MMARV)
+        if (record->faultStat & NVIC_FAULT_STAT_MMARV)
         {
-            uint32_t faultingDataAddress = NVIC_MM_ADDR_R;
+            uint32_t faultingDataAddress = record->mmAddr;
             char addrStr[12];
             itoh_be(faultingDataAddress, addrStr);
 
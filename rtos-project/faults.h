@@ -20,11 +20,22 @@
 #define PRINT_DATA_ADDRESSES        (1 << 3)
 #define PRINT_STACK_DUMP            (1 << 4)
 
+typedef struct _fault_record
+{
+    uint32_t msp;
+    uint32_t psp;
+    uint32_t frame[8];      // R0-R3, R12, LR, PC, xPSR
+    uint32_t faultStat;
+    uint32_t mmAddr;
+    uint32_t instruction;   // word at the faulting PC
+} FaultRecord;
+
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
 
 void threadSafeExit(void);
+void printMpuFault(uint32_t arg);
 void mpuFaultIsr(void);
 void triggerMpuFault();
 
@@ -37,6 +48,8 @@ void triggerBusFault();
 void usageFaultIsr(void);
 void triggerUsageFault();
 
+void captureFault(FaultRecord *record);
 void printFaultDebug(uint32_t flags);
+void printFaultRecord(const FaultRecord *record, uint32_t flags);
 
 #endif
@@ -13,6 +13,7 @@
 //-----------------------------------------------------------------------------
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "tm4c123gh6pm.h"
 #include "mm.h"
 #include "kernel.h"
@@ -21,24 +22,129 @@
 #include "faults.h"
 #include "stackHelper.h"
 #include "tasks.h"
+#include "trace.h"
+#include "profile.h"
 
-uint32_t pid = 0;
+// cpu usage accounting
+#define CYCLES_PER_EPOCH  40000000 // 1 s of cycles at 40 MHz
+#define TICKS_PER_EPOCH   1000     // 1 s of 1 ms ticks
+#define LOAD_FSHIFT       11       // bits of fixed-point precision
+#define LOAD_FIXED_1      (1 << LOAD_FSHIFT)
+#define LOAD_EXP_10S      1853     // 2048 * e^(-1/10)
+#define LOAD_EXP_60S      2014     // 2048 * e^(-1/60)
+
+#define FIRST_PID 100              // above MAX_TASKS, kill takes either
+
+uint32_t nextPid = FIRST_PID;
 uint64_t mask;
 
 //-----------------------------------------------------------------------------
 // RTOS Defines and Kernel Variables
 //-----------------------------------------------------------------------------
 
-// mutex
+// mutex pool
 mutex mutexes[MAX_MUTEXES];
+uint8_t mutexOrder[MAX_MUTEXES];
+uint8_t mutexPosition[MAX_MUTEXES];
+uint16_t mutexGeneration[MAX_MUTEXES];
+pool mutexPool;
 
-// semaphore
+// semaphore pool
 semaphore semaphores[MAX_SEMAPHORES];
+uint8_t semaphoreOrder[MAX_SEMAPHORES];
+uint8_t semaphorePosition[MAX_SEMAPHORES];
+uint16_t semaphoreGeneration[MAX_SEMAPHORES];
+pool semaphorePool;
+
+// reader-writer lock pool
+rwlock rwlocks[MAX_RWLOCKS];
+uint8_t rwlockOrder[MAX_RWLOCKS];
+uint8_t rwlockPosition[MAX_RWLOCKS];
+uint16_t rwlockGeneration[MAX_RWLOCKS];
+pool rwlockPool;
+
+// condition variable pool
+condition conditions[MAX_CONDITIONS];
+uint8_t conditionOrder[MAX_CONDITIONS];
+uint8_t conditionPosition[MAX_CONDITIONS];
+uint16_t conditionGeneration[MAX_CONDITIONS];
+pool conditionPool;
+
+// heap buffers owned by a task, ownership moves by moving srd bits
+typedef struct _buffer
+{
+    void *base;                    // from mallocHeap, NULL if slot unused
+    uint32_t size;
+    uint8_t owner;                 // only task with the buffer in its srd mask
+} buffer;
+buffer buffers[MAX_BUFFERS];
+
+// shared memory pool
+shmRegion shms[MAX_SHMS];
+uint8_t shmOrder[MAX_SHMS];
+uint8_t shmPosition[MAX_SHMS];
+uint16_t shmGeneration[MAX_SHMS];
+pool shmPool;
+
+// topic pool
+topic topics[MAX_TOPICS];
+uint8_t topicOrder[MAX_TOPICS];
+uint8_t topicPosition[MAX_TOPICS];
+uint16_t topicGeneration[MAX_TOPICS];
+pool topicPool;
+
+// stream pool
+stream streams[MAX_STREAMS];
+uint8_t streamOrder[MAX_STREAMS];
+uint8_t streamPosition[MAX_STREAMS];
+uint16_t streamGeneration[MAX_STREAMS];
+pool streamPool;
+
+// message queue pool
+msgQueue queues[MAX_QUEUES];
+uint8_t queueOrder[MAX_QUEUES];
+uint8_t queuePosition[MAX_QUEUES];
+uint16_t queueGeneration[MAX_QUEUES];
+pool queuePool;
 
 // task
 uint8_t taskCurrent = 0;          // index of last dispatched task
 uint8_t taskCount = 0;            // total number of valid tasks
-uint32_t totalWindowTicks = 0;
+
+// cpu usage accounting
+uint32_t cpuEpoch = 0;            // number of completed 1 s epochs
+uint32_t epochTicks = 0;          // ticks elapsed in the current epoch
+uint32_t lastCycleCount = 0;      // DWT_CYCCNT at the last charge
+
+// per-task state at the top of each task's stack, only that task (and the
+// kernel) can write it, so nothing here can be changed by another task
+typedef struct _taskPrivate
+{
+    volatile uint32_t schedDepth;    // scheduler lock depth
+    volatile uint32_t schedPending;  // a preemption was deferred while locked
+    handle mutexHeld[MAX_MUTEXES];   // recursive mutexes owned, set by the kernel
+    uint8_t mutexDepth[MAX_MUTEXES]; // re-entries beyond the first lock
+} taskPrivate;
+
+#define TASK_PRIVATE_BYTES ((sizeof(taskPrivate) + 7) & ~7) // keeps sp 8 aligned
+#define MAX_MUTEX_DEPTH 255
+
+// kernel state tasks read without an svc, kept in a 128 byte window that is
+// read only to tasks, so no task can redirect another through it; state a
+// task writes itself lives in its taskPrivate block
+typedef struct _kernelShared
+{
+    volatile uint8_t taskCurrent;    // running task
+    taskPrivate * volatile priv;     // private block of the running task
+    handle handles[IPC_HANDLES];     // see ipcHandles
+    uint32_t reserved[21];           // pads the struct to the mpu window
+} kernelShared;
+
+#define KERNEL_SHARED_BYTES 128
+kernelShared shared __attribute__((aligned(KERNEL_SHARED_BYTES)));
+handle * const ipcHandles = shared.handles;
+bool yieldRequested = false;      // running task gave up the cpu on purpose
+uint8_t handoffTask = MAX_TASKS;  // preferred next task on a priority tie
 
 // control
 bool priorityScheduler = true;    // priority (true) or round-robin (false)
@@ -50,49 +156,208 @@ bool preemption = true;          // preemption (true) or cooperative (false)
 struct _tcb
 {
     uint8_t state;                 // see STATE_ values above
-    void *pid;              // used to uniquely identify thread (add of task fn)
+    uint32_t pid;                  // unique id, several tasks may share a fn
+    _fn fn;                        // entry point
+    void *arg;                     // passed to fn in r0
     void *sp;                      // current stack pointer
+    uint32_t *svcFrame;            // hw frame of the last svc, R0 first
     uint8_t priority;              // 0=highest
     uint8_t currentPriority;       // 0=highest (needed for pi)
     uint32_t ticks;                // ticks until sleep complete
     uint64_t srd;                  // MPU subregion disable bits
+    uint64_t readSrd;              // subregions open read only, see mm.c
+    uint32_t blockedAt;            // cycle count when last blocked
+    uint32_t wokenAt;              // cycle count when last made ready
+    bool wakePending;              // made ready but not yet dispatched
+    LatencyInfo latency;           // wake-to-run latency histogram
+    uint32_t notifyValue;          // direct-to-task notification value
+    uint32_t notifyClear;          // bits to clear when a blocked take returns
+    bool notifyPending;            // notified since the last take
+    bool privileged;               // runs in privileged thread mode (kernel tasks)
+    uint8_t waitCount;             // sources of a blocked waitAny
+    handle waitSources[MAX_WAIT_SOURCES];
+    void *msgBuffer;               // request and reply, or receive destination
+    uint8_t msgSize;               // bytes to send, or receive capacity
+    uint8_t msgReplySize;          // reply capacity of a blocked send
+    uint8_t *msgLength;            // where a receive stores the request length
+    uint8_t msgServer;             // server of a blocked send
+    uint16_t msgSenders;           // clients send blocked on this task
+    uint8_t *streamData;           // rest of a blocked write, or read buffer
+    uint8_t streamSize;            // bytes left to write, or read capacity
+    uint8_t streamDone;            // bytes a blocked write has written
+    uint8_t queue;                 // queue a blocked send or receive waits on
+    void *queueData;               // message to send, or receive buffer
+    uint8_t queuePriority;         // priority of a blocked send
+    uint8_t *queuePriorityOut;     // where a blocked receive stores it
     char name[16];                 // name of task used in ps command
     uint8_t mutex;           // index of the mutex in use or blocking the thread
     uint8_t semaphore;     // index of the semaphore that is blocking the thread
+    uint8_t rwlock;        // index of the rw lock that is blocking the thread
     void *stackBase;
-    uint32_t time;
-    uint32_t recentTicks;       // Ticks consumed in the current 1-second window
-    uint32_t usage;               // Calculated usage (0-10000) to pass to shell
+    taskPrivate *priv;             // top of the stack, see taskPrivate
+    uint64_t cycles;               // total cpu cycles charged to the task
+    uint32_t epochCycles;          // cycles charged during epoch below
+    uint32_t epoch;                // epoch that epochCycles belongs to
+    uint32_t usage;                // usage over last full epoch (0-10000)
+    uint32_t load10s;              // 10 s moving average (fixed-point)
+    uint32_t load60s;              // 60 s moving average (fixed-point)
 } tcb[MAX_TASKS];
 
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
 
-bool initMutex(uint8_t mutex)
+// lets the owner of a recursive mutex re-enter it without an svc
+// previous is the task that just gave it up, or MAX_TASKS
+void publishMutexOwner(uint8_t m, uint8_t previous)
 {
-    bool ok = (mutex < MAX_MUTEXES);
-    if (ok)
+    uint8_t owner = mutexes[m].lockedBy;
+    if (previous < MAX_TASKS)
     {
-        mutexes[mutex].lock = false;
-        mutexes[mutex].lockedBy = 0;
+        tcb[previous].priv->mutexHeld[m] = INVALID_HANDLE;
+        tcb[previous].priv->mutexDepth[m] = 0;
+    }
+    if (mutexes[m].recursive && mutexes[m].lock)
+    {
+        tcb[owner].priv->mutexHeld[m] = poolHandle(&mutexPool, m);
+        tcb[owner].priv->mutexDepth[m] = 0;
     }
-    return ok;
 }
 
-bool initSemaphore(uint8_t semaphore, uint8_t count)
+// re-entries of a held recursive mutex, read from its owner's private block
+uint8_t mutexDepth(uint8_t m)
 {
-    bool ok = (semaphore < MAX_SEMAPHORES);
+    if (!mutexes[m].recursive || !mutexes[m].lock)
     {
-        semaphores[semaphore].count = count;
+        return 0;
     }
-    return ok;
+    return tcb[mutexes[m].lockedBy].priv->mutexDepth[m];
+}
+
+// places a task's private block at the top of its stack, returns the
+// initial stack pointer just below it
+uint32_t* initTaskPrivate(uint8_t task, void *stack, uint32_t stackBytes)
+{
+    uint8_t m;
+    taskPrivate *priv = (taskPrivate*) ((uint32_t) stack + stackBytes
+            - TASK_PRIVATE_BYTES);
+    priv->schedDepth = 0;
+    priv->schedPending = false;
+    for (m = 0; m < MAX_MUTEXES; m++)
+    {
+        priv->mutexHeld[m] = INVALID_HANDLE;
+        priv->mutexDepth[m] = 0;
+    }
+    tcb[task].priv = priv;
+    return (uint32_t*) priv;
+}
+
+// called from handler mode or by main before the rtos starts
+handle createMutexKernel(uint8_t options)
+{
+    LockStats empty = { 0 };
+    int16_t m = poolAlloc(&mutexPool);
+    if (m < 0)
+    {
+        return INVALID_HANDLE;
+    }
+    mutexes[m].recursive = (options & MUTEX_RECURSIVE) != 0;
+    mutexes[m].lock = false;
+    mutexes[m].lockedBy = 0;
+    mutexes[m].queueSize = 0;
+    mutexes[m].stats = empty;
+    return poolHandle(&mutexPool, m);
+}
+
+handle createSemaphoreKernel(uint8_t count)
+{
+    LockStats empty = { 0 };
+    int16_t s = poolAlloc(&semaphorePool);
+    if (s < 0)
+    {
+        return INVALID_HANDLE;
+    }
+    semaphores[s].count = count;
+    semaphores[s].queueSize = 0;
+    semaphores[s].stats = empty;
+    return poolHandle(&semaphorePool, s);
+}
+
+// an object that is held or has waiters cannot be deleted, nor can a mutex
+// that a condition is bound to
+bool deleteMutexKernel(handle mutex)
+{
+    int16_t m = poolLookup(&mutexPool, mutex);
+    uint8_t i;
+    if (m < 0 || mutexes[m].lock || mutexes[m].queueSize > 0)
+    {
+        return false;
+    }
+    for (i = 0; i < conditionPool.count; i++)
+    {
+        if (conditions[conditionOrder[i]].mutex == mutex)
+        {
+            return false;
+        }
+    }
+    poolFree(&mutexPool, m);
+    return true;
+}
+
+bool deleteSemaphoreKernel(handle semaphore)
+{
+    int16_t s = poolLookup(&semaphorePool, semaphore);
+    if (s < 0 || semaphores[s].queueSize > 0)
+    {
+        return false;
+    }
+    poolFree(&semaphorePool, s);
+    return true;
 }
 
 // REQUIRED: initialize systick for 1ms system timer
 void initRtos(void)
 {
-    totalWindowTicks = 0;
+    // start the DWT cycle counter used for cpu accounting
+    NVIC_DBG_INT_R |= NVIC_DBG_INT_TRCENA;
+    DWT_CYCCNT_R = 0;
+    DWT_CTRL_R |= DWT_CTRL_CYCCNTENA;
+    cpuEpoch = 0;
+    epochTicks = 0;
+    lastCycleCount = 0;
+
+    allowSharedAccess(&shared, KERNEL_SHARED_BYTES);
+
+    initPool(&mutexPool, OBJECT_MUTEX, MAX_MUTEXES, mutexOrder, mutexPosition,
+             mutexGeneration);
+    initPool(&semaphorePool, OBJECT_SEMAPHORE, MAX_SEMAPHORES, semaphoreOrder,
+             semaphorePosition, semaphoreGeneration);
+    initPool(&rwlockPool, OBJECT_RWLOCK, MAX_RWLOCKS, rwlockOrder,
+             rwlockPosition, rwlockGeneration);
+    initPool(&conditionPool, OBJECT_CONDITION, MAX_CONDITIONS, conditionOrder,
+             conditionPosition, conditionGeneration);
+    initPool(&shmPool, OBJECT_SHM, MAX_SHMS, shmOrder, shmPosition,
+             shmGeneration);
+    initPool(&topicPool, OBJECT_TOPIC, MAX_TOPICS, topicOrder, topicPosition,
+             topicGeneration);
+    initPool(&streamPool, OBJECT_STREAM, MAX_STREAMS, streamOrder,
+             streamPosition, streamGeneration);
+    initPool(&queuePool, OBJECT_QUEUE, MAX_QUEUES, queueOrder, queuePosition,
+             queueGeneration);
+
+    // pendsv lowest so a switch never preempts an isr, svc and systick share
+    // a level so they never preempt each other
+    NVIC_SYS_PRI1_R = (NVIC_SYS_PRI1_R & ~(NVIC_SYS_PRI1_USAGE_M | NVIC_SYS_PRI1_BUS_M
+            | NVIC_SYS_PRI1_MEM_M))
+            | (PRIORITY_FAULT << NVIC_SYS_PRI1_USAGE_S)
+            | (PRIORITY_FAULT << NVIC_SYS_PRI1_BUS_S)
+            | (PRIORITY_FAULT << NVIC_SYS_PRI1_MEM_S);
+    NVIC_SYS_PRI2_R = (NVIC_SYS_PRI2_R & ~NVIC_SYS_PRI2_SVC_M)
+            | (PRIORITY_SVC << NVIC_SYS_PRI2_SVC_S);
+    NVIC_SYS_PRI3_R = (NVIC_SYS_PRI3_R & ~(NVIC_SYS_PRI3_TICK_M | NVIC_SYS_PRI3_PENDSV_M))
+            | (PRIORITY_SYSTICK << NVIC_SYS_PRI3_TICK_S)
+            | (PRIORITY_PENDSV << NVIC_SYS_PRI3_PENDSV_S);
+
     NVIC_ST_RELOAD_R = 39999;
     NVIC_ST_CURRENT_R = 0;
     NVIC_ST_CTRL_R |= NVIC_ST_CTRL_ENABLE | NVIC_ST_CTRL_INTEN
@@ -106,275 +371,2012 @@ void initRtos(void)
     {
         tcb[i].state = STATE_INVALID;
         tcb[i].pid = 0;
-        tcb[i].time = 0;
+        tcb[i].fn = 0;
     }
 }
 
-// REQUIRED: Implement prioritization to NUM_PRIORITIES
-uint8_t rtosScheduler(void)
+//-----------------------------------------------------------------------------
+// Critical sections
+//-----------------------------------------------------------------------------
+
+// masks every isr at or below PRIORITY_KERNEL_MAX and returns the old mask so
+// sections can nest; zero latency isrs keep running
+// svc is masked too, so no SVC may be issued inside a critical section
+uint32_t enterCritical(void)
 {
-    bool ok;
-    static uint8_t task = 0xFF;
-    ok = false;
-    if (priorityScheduler)
+    uint32_t basepri = getBasepri();
+    raiseBasepri(PRIORITY_TO_BASEPRI(PRIORITY_KERNEL_MAX));
+    return basepri;
+}
+
+void exitCritical(uint32_t basepri)
+{
+    setBasepri(basepri);
+}
+
+// computes x^n for a fixed-point x in O(log n)
+uint32_t fixedPower(uint32_t x, uint32_t n)
+{
+    uint32_t result = LOAD_FIXED_1;
+    while (n)
     {
-        uint8_t highestPrio = 255;
-        uint8_t start = (taskCurrent + 1) % MAX_TASKS;
-        int i = start;
-        task = 0;
-        do
+        if (n & 1)
         {
-            if (tcb[i].state == STATE_READY || tcb[i].state == STATE_UNRUN)
-            {
-                if (tcb[i].currentPriority < highestPrio) // Check dynamic priority
-                {
-                    task = i;
-                    highestPrio = tcb[task].currentPriority;
-                }
-            }
-            i = (i + 1) % MAX_TASKS; // wrap around to not pick current task for next task
+            result = (result * x + LOAD_FIXED_1 / 2) >> LOAD_FSHIFT;
         }
-        while (i != start);
-        ok = true;
+        n >>= 1;
+        x = (x * x + LOAD_FIXED_1 / 2) >> LOAD_FSHIFT;
     }
-    else
+    return result;
+}
+
+// folds a finished epoch sample into a moving average, then decays it
+// for the idle epochs that followed
+uint32_t calcLoad(uint32_t load, uint32_t exp, uint32_t sample, uint32_t idle)
+{
+    load = ((uint64_t) load * exp
+            + (uint64_t) (sample << LOAD_FSHIFT) * (LOAD_FIXED_1 - exp))
+            >> LOAD_FSHIFT;
+    if (idle)
     {
-        while (!ok)
-        {
-            task++;
-            if (task >= MAX_TASKS)
-                task = 0;
-            ok = (tcb[task].state == STATE_READY
-                    || tcb[task].state == STATE_UNRUN);
-        }
+        load = ((uint64_t) load * fixedPower(exp, idle)) >> LOAD_FSHIFT;
     }
+    return load;
+}
 
-    if (task == 0xFF)
+// brings a task's usage figures up to the current epoch
+// only touches the one task, so no window sweep is needed
+void foldCpuUsage(uint8_t task)
+{
+    uint32_t elapsed = cpuEpoch - tcb[task].epoch;
+    if (elapsed == 0)
     {
-        task = 0;
+        return;
     }
 
-    if (tcb[task].state == STATE_UNRUN)
+    uint32_t sample = ((uint64_t) tcb[task].epochCycles * 10000)
+            / CYCLES_PER_EPOCH;
+    if (sample > 10000)
     {
-        tcb[task].state = STATE_READY;
+        sample = 10000;
     }
 
-    return task;
+    tcb[task].usage = (elapsed == 1) ? sample : 0;
+    tcb[task].load10s = calcLoad(tcb[task].load10s, LOAD_EXP_10S, sample,
+                                 elapsed - 1);
+    tcb[task].load60s = calcLoad(tcb[task].load60s, LOAD_EXP_60S, sample,
+                                 elapsed - 1);
+    tcb[task].epochCycles = 0;
+    tcb[task].epoch = cpuEpoch;
 }
 
-// REQUIRED: modify this function to start the operating system
-// by calling scheduler, set srd bits, setting PSP, ASP bit, call fn with fn add in R0
-// fn set TMPL bit, and PC <= fn
-void startRtos(void)
+// charges cycles since the last charge to the running task
+void chargeCpuCycles(void)
 {
-    taskCurrent = rtosScheduler();
-    tcb[taskCurrent].state = STATE_READY;
+    uint32_t now = DWT_CYCCNT_R;
+    uint32_t delta = now - lastCycleCount;
+    lastCycleCount = now;
 
-    // apply MPU settings to task
-    applySramAccessMask(tcb[taskCurrent].srd);
+    foldCpuUsage(taskCurrent);
+    tcb[taskCurrent].cycles += delta;
+    tcb[taskCurrent].epochCycles += delta;
+}
 
-    uint32_t *psp = tcb[taskCurrent].sp;
-    setPsp(psp);
-    loadR3((uint32_t) tcb[taskCurrent].pid);
-    setAspBit();
-    setTMPL();
-    setPC();
+void resetCpuUsage(uint8_t task)
+{
+    tcb[task].cycles = 0;
+    tcb[task].epochCycles = 0;
+    tcb[task].epoch = cpuEpoch;
+    tcb[task].usage = 0;
+    tcb[task].load10s = 0;
+    tcb[task].load60s = 0;
 }
 
-// REQUIRED:
-// add task if room in task list
-// store the thread name
-// allocate stack space and store top of stack in sp and spInit
-// set the srd bits based on the memory allocation
-bool createThread(_fn fn, const char name[], uint8_t priority,
-                  uint32_t stackBytes)
+// accounts for a task that blocked on a lock and has now acquired it
+void recordLockWait(LockStats *stats, uint8_t task, uint32_t now)
 {
-    bool ok = false;
-    uint8_t i = 0;
-    bool found = false;
-    if (taskCount < MAX_TASKS)
+    uint32_t waited = now - tcb[task].blockedAt;
+    stats->acquisitions++;
+    stats->totalWait += waited;
+    if (waited > stats->maxWait)
     {
-        // make sure fn not already in list (prevent reentrancy)
-        while (!found && (i < MAX_TASKS))
-        {
-            found = (tcb[i++].pid == fn);
-        }
-        if (!found)
-        {
-            // find first available tcb record
-            i = 0;
-            while (tcb[i].state != STATE_INVALID)
-            {
-                i++;
-                if (i >= MAX_TASKS)
-                {
-                    // No available space in the tcb
-                    return false;
-                }
-            }
-
-            // allocate memory for the process
-            void *stack = mallocHeap(stackBytes);
-            if (stack == NULL)
-            {
-                return false;
-            }
-            tcb[i].stackBase = stack;
-
-            // set srd bits for tcb
-            tcb[i].srd = createNoSramAccessMask();
-            addSramAccessWindow(&tcb[i].srd, (uint32_t*) stack, stackBytes);
-
-            // set stack pointer dummy variables
-            uint32_t *sp = (uint32_t*) ((uint32_t) stack + stackBytes);
-            *(--sp) = 0x01000000;     // xPSR
-            *(--sp) = (uint32_t) fn;  // PC
-            *(--sp) = 0xFFFFFFFD;     // LR
-            *(--sp) = 0x12121212;     // R12
-            *(--sp) = 0x03030303;     // R3
-            *(--sp) = 0x02020202;     // R2
-            *(--sp) = 0x01010101;     // R1
-            *(--sp) = 0x00000000;     // R0
-            *(--sp) = 0x11111111;     // R11
-            *(--sp) = 0x10101010;     // R10
-            *(--sp) = 0x09090909;     // R9
-            *(--sp) = 0x08080808;     // R8
-            *(--sp) = 0x07070707;     // R7
-            *(--sp) = 0x06060606;     // R6
-            *(--sp) = 0x05050505;     // R5
-            *(--sp) = 0x04040404;     // R4
-            tcb[i].sp = sp;
-            // set tcb properties
-            tcb[i].state = STATE_UNRUN;
-            tcb[i].pid = fn;
-            strncpy(tcb[i].name, name, sizeof(tcb[i].name));
-            tcb[i].priority = priority;
-            tcb[i].currentPriority = priority;
-
-            // increment task count
-            taskCount++;
-            ok = true;
-        }
+        stats->maxWait = waited;
     }
-    return ok;
 }
 
-// REQUIRED: modify this function to kill a thread
-// REQUIRED: free memory, remove any pending semaphore waiting,
-//           unlock any mutexes, mark state as killed
-void killThread(_fn fn)
+void recordLockHold(LockStats *stats, uint32_t lockedAt, uint32_t now)
 {
-    __asm(" SVC #6 ");
+    uint32_t held = now - lockedAt;
+    if (held > stats->maxHold)
+    {
+        stats->maxHold = held;
+    }
 }
 
-void destroyThread(uint32_t pid)
+// makes a blocked or delayed task ready, reason is a TRACE_WAKE_ value
+// all wake paths go through here so a task that outranks the running one
+// is switched to on the next exception return instead of the next tick
+void wakeTask(uint8_t task, uint8_t reason)
 {
-    __asm(" SVC #6 ");
+    tcb[task].state = STATE_READY;
+    tcb[task].wokenAt = DWT_CYCCNT_R;
+    tcb[task].wakePending = true;
+    traceRecord(TRACE_WAKE, task, reason);
+
+    if (priorityScheduler
+            && tcb[task].currentPriority < tcb[taskCurrent].currentPriority)
+    {
+        triggerPendSvFault();
+    }
 }
 
-// REQUIRED: modify this function to restart a thread, including creating a stack
-void restartThread(_fn fn)
+// sets the value a blocked task's svc call returns when it resumes
+// tasks only block inside an svc, and its frame stays put when pendSvIsr
+// saves R4-R11 below it, so this is safe before the switch has happened
+void setStackedR0(uint8_t task, uint32_t value)
 {
-    __asm(" SVC #11 ");
+    tcb[task].svcFrame[0] = value;
 }
-void restartThreadKernel(_fn fn)
+
+// removes a task from a semaphore queue, if it is there
+void semaphoreDequeue(uint8_t s, uint8_t task)
 {
-    int i;
-    int taskIndex = -1;
-    for (i = 0; i < MAX_TASKS; i++)
+    uint8_t q;
+    uint8_t k;
+    for (q = 0; q < semaphores[s].queueSize; q++)
     {
-        if (tcb[i].pid == fn)
+        if (semaphores[s].processQueue[q] == task)
         {
-            taskIndex = i;
-            break;
+            for (k = q; k < semaphores[s].queueSize - 1; k++)
+            {
+                semaphores[s].processQueue[k] = semaphores[s].processQueue[k + 1];
+            }
+            semaphores[s].queueSize--;
+            return;
         }
     }
+}
 
-    if (taskIndex != -1
-            && (tcb[taskIndex].state == STATE_KILLED
-                    || tcb[taskIndex].state == STATE_UNRUN))
+// completes a waitAny: leaves every other queue and returns the index of
+// the source that fired
+void finishWaitAny(uint8_t task, uint8_t index, uint8_t reason)
+{
+    uint8_t i;
+    int16_t s;
+    for (i = 0; i < tcb[task].waitCount; i++)
     {
-        uint32_t stackBytes = 1024;
-        void *stack = mallocHeap(stackBytes);
-        if (stack == NULL)
+        s = poolLookup(&semaphorePool, tcb[task].waitSources[i]);
+        if (i != index && s >= 0)
         {
-            return;
+            semaphoreDequeue(s, task);
         }
+    }
+    tcb[task].waitCount = 0;
+    setStackedR0(task, index);
+    wakeTask(task, reason);
+}
 
-        tcb[taskIndex].stackBase = stack;
-
-        tcb[taskIndex].srd = createNoSramAccessMask();
-        addSramAccessWindow(&tcb[taskIndex].srd, (uint32_t*) stack, stackBytes);
-
-        uint32_t *sp = (uint32_t*) ((uint32_t) stack + stackBytes);
-        *(--sp) = 0x01000000;     // xPSR
-        *(--sp) = (uint32_t) fn;  // PC
-        *(--sp) = 0xFFFFFFFD;     // LR
-        *(--sp) = 0x12121212;     // R12
-        *(--sp) = 0x03030303;     // R3
-        *(--sp) = 0x02020202;     // R2
-        *(--sp) = 0x01010101;     // R1
-        *(--sp) = 0x00000000;     // R0
-        *(--sp) = 0x11111111;     // R11
-        *(--sp) = 0x10101010;     // R10
-        *(--sp) = 0x09090909;     // R9
-        *(--sp) = 0x08080808;     // R8
-        *(--sp) = 0x07070707;     // R7
-        *(--sp) = 0x06060606;     // R6
-        *(--sp) = 0x05050505;     // R5
-        *(--sp) = 0x04040404;     // R4
-
-        tcb[taskIndex].sp = sp;
+// updates a task's notification value and releases a blocked take
+// runs in handler mode, called from svc and from isrs
+bool notifyKernel(uint8_t task, uint32_t value, uint8_t action)
+{
+    if (task >= MAX_TASKS || tcb[task].state == STATE_INVALID
+            || tcb[task].state == STATE_KILLED)
+    {
+        return false;
+    }
 
-        // Reset State
-        tcb[taskIndex].state = STATE_READY;
+    switch (action)
+    {
+    case NOTIFY_GIVE:
+        tcb[task].notifyValue++;
+        break;
+    case NOTIFY_SET_BITS:
+        tcb[task].notifyValue |= value;
+        break;
+    case NOTIFY_INCREMENT:
+        tcb[task].notifyValue += value;
+        break;
+    case NOTIFY_OVERWRITE:
+        tcb[task].notifyValue = value;
+        break;
+    default:
+        return false;
+    }
 
+    if (tcb[task].state == STATE_BLOCKED_NOTIFY)
+    {
+        setStackedR0(task, tcb[task].notifyValue);
+        tcb[task].notifyValue &= ~tcb[task].notifyClear;
+        tcb[task].notifyPending = false;
+        wakeTask(task, TRACE_WAKE_NOTIFY);
+    }
+    else
+    {
+        // a waitAny only reports the notification, notifyTake consumes it
+        tcb[task].notifyPending = true;
+        if (tcb[task].state == STATE_BLOCKED_ANY)
+        {
+            uint8_t i;
+            for (i = 0; i < tcb[task].waitCount; i++)
+            {
+                if (tcb[task].waitSources[i] == NOTIFY_SOURCE)
+                {
+                    finishWaitAny(task, i, TRACE_WAKE_NOTIFY);
+                    break;
+                }
+            }
+        }
     }
+    return true;
 }
 
-// REQUIRED: modify this function to set a thread priority
-void setThreadPriority(_fn fn, uint8_t priority)
+// releases the first waiter or increments the count
+// runs in handler mode, called from svc and from isrs
+void postKernel(uint8_t s)
 {
-    __asm(" SVC #14 ");
-}
+    if (semaphores[s].queueSize > 0)
+    {
+        uint8_t waitingTask = semaphores[s].processQueue[0];
+        recordLockWait(&semaphores[s].stats, waitingTask, DWT_CYCCNT_R);
 
-// REQUIRED: modify this function to yield execution back to scheduler using pendsv
-void yield(void)
-{
-    __asm(" SVC #0 ");
-}
+        int i = 0;
+        for (i = 0; i < semaphores[s].queueSize - 1; i++)
+        {
+            semaphores[s].processQueue[i] = semaphores[s].processQueue[i + 1];
+        }
+        semaphores[s].queueSize--;
 
-// REQUIRED: modify this function to support 1ms system timer
-// execution yielded back to scheduler until time elapses using pendsv
-void sleep(uint32_t tick)
-{
-    __asm(" SVC #1 ");
+        if (tcb[waitingTask].state == STATE_BLOCKED_ANY)
+        {
+            for (i = 0; i < tcb[waitingTask].waitCount; i++)
+            {
+                if (poolLookup(&semaphorePool, tcb[waitingTask].waitSources[i]) == s)
+                {
+                    finishWaitAny(waitingTask, i, TRACE_WAKE_SEMAPHORE);
+                    break;
+                }
+            }
+        }
+        else
+        {
+            wakeTask(waitingTask, TRACE_WAKE_SEMAPHORE);
+        }
+    }
+    else
+    {
+        semaphores[s].count++;
+    }
 }
 
-// REQUIRED: modify this function to wait a semaphore using pendsv
-void wait(int8_t semaphore)
-{
-    __asm(" SVC #4 ");
-}
+//-----------------------------------------------------------------------------
+// Priority inheritance
+//-----------------------------------------------------------------------------
 
-// REQUIRED: modify this function to signal a semaphore is available using pendsv
-void post(int8_t semaphore)
+// sets a task's effective priority from every source that may lend it one:
+// its base priority, waiters on the locks it holds and its message clients
+// recomputed as a whole so dropping one source never drops the others
+void inheritPriority(uint8_t task)
 {
-    __asm(" SVC #5 ");
-}
+    uint8_t prio = tcb[task].priority;
+    uint8_t l;
+    uint8_t q;
+    uint8_t i;
 
-// REQUIRED: modify this function to lock a mutex using pendsv
-void lock(int8_t mutex)
-{
-    __asm(" SVC #2 ");
-}
+    if (priorityInheritance)
+    {
+        for (l = 0; l < mutexPool.count; l++)
+        {
+            mutex *mx = &mutexes[mutexOrder[l]];
+            if (mx->lock && mx->lockedBy == task)
+            {
+                for (q = 0; q < mx->queueSize; q++)
+                {
+                    if (tcb[mx->processQueue[q]].currentPriority < prio)
+                    {
+                        prio = tcb[mx->processQueue[q]].currentPriority;
+                    }
+                }
+            }
+        }
+        for (l = 0; l < rwlockPool.count; l++)
+        {
+            rwlock *rw = &rwlocks[rwlockOrder[l]];
+            if ((rw->writeLocked && rw->writer == task)
+                    || (rw->readers & (1 << task)))
+            {
+                for (q = 0; q < rw->queueSize; q++)
+                {
+                    if (tcb[rw->processQueue[q]].currentPriority < prio)
+                    {
+                        prio = tcb[rw->processQueue[q]].currentPriority;
+                    }
+                }
+            }
+        }
+    }
+
+    // a server runs at the priority of its most important client, queued or
+    // waiting for a reply
+    for (i = 0; i < MAX_TASKS; i++)
+    {
+        if (((tcb[task].msgSenders & (1 << i))
+                || (tcb[i].state == STATE_BLOCKED_REPLY
+                        && tcb[i].msgServer == task))
+                && tcb[i].currentPriority < prio)
+        {
+            prio = tcb[i].currentPriority;
+        }
+    }
+    tcb[task].currentPriority = prio;
+}
+
+//-----------------------------------------------------------------------------
+// Mutexes
+//-----------------------------------------------------------------------------
+
+void mutexAcquire(uint8_t m, uint8_t task)
+{
+    mutexes[m].lockedBy = task;
+    mutexes[m].lock = true;
+    mutexes[m].lockedAt = DWT_CYCCNT_R;
+    mutexes[m].stats.acquisitions++;
+    tcb[task].mutex = m;
+    publishMutexOwner(m, MAX_TASKS);
+}
+
+// blocks a task on a held mutex and lends its priority to the owner
+void mutexEnqueue(uint8_t m, uint8_t task)
+{
+    mutexes[m].processQueue[mutexes[m].queueSize] = task;
+    mutexes[m].queueSize++;
+    tcb[task].state = STATE_BLOCKED_MUTEX;
+    tcb[task].mutex = m;
+    tcb[task].blockedAt = DWT_CYCCNT_R;
+    mutexes[m].stats.contentions++;
+
+    if (priorityInheritance)
+    {
+        uint8_t owner = mutexes[m].lockedBy;
+        // If the blocked task is more important than the owner
+        if (tcb[task].currentPriority < tcb[owner].currentPriority)
+        {
+            // Promote the owner to the higher priority
+            tcb[owner].currentPriority = tcb[task].currentPriority;
+        }
+    }
+}
+
+// releases a held mutex, handing it to the first waiter if there is one
+void mutexRelease(uint8_t m)
+{
+    uint8_t owner = mutexes[m].lockedBy;
+    uint32_t now = DWT_CYCCNT_R;
+    recordLockHold(&mutexes[m].stats, mutexes[m].lockedAt, now);
+
+    if (mutexes[m].queueSize > 0)
+    {
+        uint8_t newMutexOwner = mutexes[m].processQueue[0];
+        wakeTask(newMutexOwner, TRACE_WAKE_MUTEX);
+        mutexes[m].lockedBy = newMutexOwner;
+        mutexes[m].lockedAt = now;
+        recordLockWait(&mutexes[m].stats, newMutexOwner, now);
+
+        int i = 0;
+        for (i = 0; i < mutexes[m].queueSize - 1; i++)
+        {
+            mutexes[m].processQueue[i] = mutexes[m].processQueue[i + 1];
+        }
+
+        mutexes[m].queueSize--;
+    }
+    else
+    {
+        // No one waiting: just unlock
+        mutexes[m].lock = false;
+        mutexes[m].lockedBy = 0;
+    }
+    // Update the owner's record to show it holds nothing
+    tcb[owner].mutex = 0;
+    publishMutexOwner(m, owner);
+
+    // the old owner keeps any boost from other locks or message clients,
+    // the new one inherits from the waiters still queued
+    inheritPriority(owner);
+    if (mutexes[m].lock)
+    {
+        inheritPriority(mutexes[m].lockedBy);
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Reader-writer locks
+//-----------------------------------------------------------------------------
+
+// Readers share the lock, a writer holds it alone. A queued writer stops new
+// readers from entering, so a steady stream of readers cannot starve it.
+// Read locks do not nest and a reader must not ask for the write lock.
+
+handle createRwLockKernel(void)
+{
+    LockStats empty = { 0 };
+    int16_t r = poolAlloc(&rwlockPool);
+    if (r < 0)
+    {
+        return INVALID_HANDLE;
+    }
+    rwlocks[r].writeLocked = false;
+    rwlocks[r].readerCount = 0;
+    rwlocks[r].readers = 0;
+    rwlocks[r].writersWaiting = 0;
+    rwlocks[r].wantsWrite = 0;
+    rwlocks[r].queueSize = 0;
+    rwlocks[r].stats = empty;
+    return poolHandle(&rwlockPool, r);
+}
+
+bool deleteRwLockKernel(handle rw)
+{
+    int16_t r = poolLookup(&rwlockPool, rw);
+    if (r < 0 || rwlocks[r].writeLocked || rwlocks[r].readerCount > 0
+            || rwlocks[r].queueSize > 0)
+    {
+        return false;
+    }
+    poolFree(&rwlockPool, r);
+    return true;
+}
+
+// queues the running task and lends its priority to every holder
+void rwBlock(uint8_t r, bool write)
+{
+    rwlock *rw = &rwlocks[r];
+    uint8_t i;
+
+    rw->processQueue[rw->queueSize] = taskCurrent;
+    rw->queueSize++;
+    if (write)
+    {
+        rw->wantsWrite |= 1 << taskCurrent;
+        rw->writersWaiting++;
+    }
+    tcb[taskCurrent].state = STATE_BLOCKED_RWLOCK;
+    tcb[taskCurrent].rwlock = r;
+    tcb[taskCurrent].blockedAt = DWT_CYCCNT_R;
+    rw->stats.contentions++;
+
+    if (priorityInheritance)
+    {
+        for (i = 0; i < MAX_TASKS; i++)
+        {
+            bool holder = (rw->writeLocked && rw->writer == i)
+                    || (rw->readers & (1 << i));
+            if (holder && tcb[taskCurrent].currentPriority < tcb[i].currentPriority)
+            {
+                tcb[i].currentPriority = tcb[taskCurrent].currentPriority;
+            }
+        }
+    }
+    triggerPendSvFault();
+}
+
+void rwDequeue(rwlock *rw, uint8_t q)
+{
+    uint8_t task = rw->processQueue[q];
+    if (rw->wantsWrite & (1 << task))
+    {
+        rw->wantsWrite &= ~(1 << task);
+        rw->writersWaiting--;
+    }
+    for (; q < rw->queueSize - 1; q++)
+    {
+        rw->processQueue[q] = rw->processQueue[q + 1];
+    }
+    rw->queueSize--;
+}
+
+// admits waiters the lock can now take: the first writer once it is free,
+// or every reader when no writer is waiting
+void rwGrant(uint8_t r, uint8_t reason)
+{
+    rwlock *rw = &rwlocks[r];
+    uint32_t now = DWT_CYCCNT_R;
+    uint8_t task;
+    uint8_t q;
+
+    if (rw->writeLocked)
+    {
+        return;
+    }
+    if (rw->writersWaiting > 0)
+    {
+        if (rw->readerCount > 0)
+        {
+            return;
+        }
+        q = 0;
+        while (!(rw->wantsWrite & (1 << rw->processQueue[q])))
+        {
+            q++;
+        }
+        task = rw->processQueue[q];
+        rwDequeue(rw, q);
+        rw->writeLocked = true;
+        rw->writer = task;
+        rw->lockedAt = now;
+        recordLockWait(&rw->stats, task, now);
+        wakeTask(task, reason);
+    }
+    else
+    {
+        // no writer is waiting, so everything queued is a reader
+        while (rw->queueSize > 0)
+        {
+            task = rw->processQueue[0];
+            rwDequeue(rw, 0);
+            rw->readers |= 1 << task;
+            rw->readerCount++;
+            recordLockWait(&rw->stats, task, now);
+            wakeTask(task, reason);
+        }
+    }
+}
+
+// drops whatever the task holds, returns false if it held nothing
+bool rwRelease(uint8_t r, uint8_t task, uint8_t reason)
+{
+    rwlock *rw = &rwlocks[r];
+
+    if (rw->writeLocked && rw->writer == task)
+    {
+        recordLockHold(&rw->stats, rw->lockedAt, DWT_CYCCNT_R);
+        rw->writeLocked = false;
+    }
+    else if (rw->readers & (1 << task))
+    {
+        rw->readers &= ~(1 << task);
+        rw->readerCount--;
+    }
+    else
+    {
+        return false;
+    }
+
+    rwGrant(r, reason);
+    inheritPriority(task);
+    return true;
+}
+
+//-----------------------------------------------------------------------------
+// Condition variables
+//-----------------------------------------------------------------------------
+
+// A waiter gives up the bound mutex and sleeps on the condition. Signal and
+// broadcast move waiters straight onto the mutex queue, so each one wakes
+// holding the mutex instead of waking only to block on it again.
+
+handle createConditionKernel(handle mutex)
+{
+    int16_t c;
+    if (poolLookup(&mutexPool, mutex) < 0)
+    {
+        return INVALID_HANDLE;
+    }
+    c = poolAlloc(&conditionPool);
+    if (c < 0)
+    {
+        return INVALID_HANDLE;
+    }
+    conditions[c].mutex = mutex;
+    conditions[c].queueSize = 0;
+    return poolHandle(&conditionPool, c);
+}
+
+bool deleteConditionKernel(handle cv)
+{
+    int16_t c = poolLookup(&conditionPool, cv);
+    if (c < 0 || conditions[c].queueSize > 0)
+    {
+        return false;
+    }
+    poolFree(&conditionPool, c);
+    return true;
+}
+
+// hands the first waiter to the bound mutex, returns false if none waited
+bool conditionWake(uint8_t c)
+{
+    condition *cv = &conditions[c];
+    int16_t m = poolLookup(&mutexPool, cv->mutex);
+    uint8_t task;
+    uint8_t i;
+
+    if (cv->queueSize == 0)
+    {
+        return false;
+    }
+    task = cv->processQueue[0];
+    for (i = 0; i < cv->queueSize - 1; i++)
+    {
+        cv->processQueue[i] = cv->processQueue[i + 1];
+    }
+    cv->queueSize--;
+
+    if (mutexes[m].lock)
+    {
+        mutexEnqueue(m, task);
+    }
+    else
+    {
+        mutexAcquire(m, task);
+        wakeTask(task, TRACE_WAKE_CONDITION);
+    }
+    return true;
+}
+
+void sleepKernel(uint32_t ticks)
+{
+    tcb[taskCurrent].state = STATE_DELAYED;
+    tcb[taskCurrent].ticks = ticks;
+    triggerPendSvFault();
+}
+
+// returns the index of a ready source, or blocks on all of them with the
+// result left in r0 by whichever fires first
+int8_t waitAnyKernel(const handle sources[], uint8_t count)
+{
+    uint8_t i;
+    uint8_t j;
+    int16_t s;
+    if (count == 0 || count > MAX_WAIT_SOURCES)
+    {
+        return -1;
+    }
+    for (i = 0; i < count; i++)
+    {
+        if (sources[i] != NOTIFY_SOURCE
+                && poolLookup(&semaphorePool, sources[i]) < 0)
+        {
+            return -1;
+        }
+        // semaphore queues hold each task once, a repeat would overrun them
+        for (j = 0; j < i; j++)
+        {
+            if (sources[j] == sources[i])
+            {
+                return -1;
+            }
+        }
+    }
+    for (i = 0; i < count; i++)
+    {
+        if (sources[i] == NOTIFY_SOURCE)
+        {
+            if (tcb[taskCurrent].notifyPending)
+            {
+                return i;
+            }
+        }
+        else
+        {
+            s = poolLookup(&semaphorePool, sources[i]);
+            if (semaphores[s].count > 0)
+            {
+                semaphores[s].count--;
+                semaphores[s].stats.acquisitions++;
+                return i;
+            }
+        }
+    }
+    for (i = 0; i < count; i++)
+    {
+        tcb[taskCurrent].waitSources[i] = sources[i];
+        if (sources[i] != NOTIFY_SOURCE)
+        {
+            s = poolLookup(&semaphorePool, sources[i]);
+            semaphores[s].processQueue[semaphores[s].queueSize] = taskCurrent;
+            semaphores[s].queueSize++;
+            semaphores[s].stats.contentions++;
+        }
+    }
+    tcb[taskCurrent].waitCount = count;
+    tcb[taskCurrent].state = STATE_BLOCKED_ANY;
+    tcb[taskCurrent].blockedAt = DWT_CYCCNT_R;
+    triggerPendSvFault();
+    return -1;
+}
+
+// copies a message between task buffers, bounded by the smaller size
+uint8_t copyMessage(void *to, const void *from, uint8_t size, uint8_t limit)
+{
+    uint8_t i;
+    if (size > limit)
+    {
+        size = limit;
+    }
+    if (size > MAX_MESSAGE_SIZE)
+    {
+        size = MAX_MESSAGE_SIZE;
+    }
+    for (i = 0; i < size; i++)
+    {
+        ((uint8_t*) to)[i] = ((const uint8_t*) from)[i];
+    }
+    return size;
+}
+
+// copies a request into the server, the client then waits for the reply
+void messageDeliver(uint8_t client, uint8_t server)
+{
+    *tcb[server].msgLength = copyMessage(tcb[server].msgBuffer,
+                                         tcb[client].msgBuffer,
+                                         tcb[client].msgSize,
+                                         tcb[server].msgSize);
+    tcb[server].msgSenders &= ~(1 << client);
+    tcb[client].state = STATE_BLOCKED_REPLY;
+    inheritPriority(server);
+}
+
+// sends a request and blocks until the reply, returns the reply length
+// the reply is left in r0 by replyKernel, -1 stays there if the server dies
+int16_t sendKernel(uint8_t server, void *buffer, uint8_t size,
+                   uint8_t replySize)
+{
+    if (server >= MAX_TASKS || server == taskCurrent
+            || tcb[server].state == STATE_INVALID
+            || tcb[server].state == STATE_KILLED || size > MAX_MESSAGE_SIZE)
+    {
+        return -1;
+    }
+    tcb[taskCurrent].msgBuffer = buffer;
+    tcb[taskCurrent].msgSize = size;
+    tcb[taskCurrent].msgReplySize = replySize;
+    tcb[taskCurrent].msgServer = server;
+    tcb[taskCurrent].blockedAt = DWT_CYCCNT_R;
+    if (tcb[server].state == STATE_BLOCKED_RECEIVE)
+    {
+        // switch straight to the server rather than a peer of the client
+        messageDeliver(taskCurrent, server);
+        setStackedR0(server, taskCurrent);
+        wakeTask(server, TRACE_WAKE_MESSAGE);
+        handoffTask = server;
+    }
+    else
+    {
+        tcb[server].msgSenders |= 1 << taskCurrent;
+        tcb[taskCurrent].state = STATE_BLOCKED_SEND;
+        inheritPriority(server);
+    }
+    triggerPendSvFault();
+    return -1;
+}
+
+// takes the most important pending request, or blocks until one is sent
+// returns the client to reply to, the request length is stored in *length
+int8_t receiveKernel(void *buffer, uint8_t *length)
+{
+    uint8_t i;
+    uint8_t client = MAX_TASKS;
+    tcb[taskCurrent].msgBuffer = buffer;
+    tcb[taskCurrent].msgSize = *length;
+    tcb[taskCurrent].msgLength = length;
+    for (i = 0; i < MAX_TASKS; i++)
+    {
+        if ((tcb[taskCurrent].msgSenders & (1 << i))
+                && (client == MAX_TASKS
+                        || tcb[i].currentPriority < tcb[client].currentPriority))
+        {
+            client = i;
+        }
+    }
+    if (client < MAX_TASKS)
+    {
+        messageDeliver(client, taskCurrent);
+        return client;
+    }
+    tcb[taskCurrent].state = STATE_BLOCKED_RECEIVE;
+    tcb[taskCurrent].blockedAt = DWT_CYCCNT_R;
+    triggerPendSvFault();
+    return -1;
+}
+
+// copies the reply to a client blocked on this task and releases it
+bool replyKernel(uint8_t client, const void *reply, uint8_t size)
+{
+    if (client >= MAX_TASKS || tcb[client].state != STATE_BLOCKED_REPLY
+            || tcb[client].msgServer != taskCurrent)
+    {
+        return false;
+    }
+    setStackedR0(client, copyMessage(tcb[client].msgBuffer, reply, size,
+                                     tcb[client].msgReplySize));
+    tcb[client].state = STATE_READY;
+    inheritPriority(taskCurrent);
+    if (tcb[client].currentPriority < tcb[taskCurrent].currentPriority)
+    {
+        handoffTask = client;
+    }
+    wakeTask(client, TRACE_WAKE_MESSAGE);
+    return true;
+}
+
+// reprograms the mpu for the running task
+void applyTaskAccess(void)
+{
+    applySramAccessMask(tcb[taskCurrent].srd);
+    applySramReadMask(tcb[taskCurrent].readSrd);
+}
+
+// returns the buffer slot owned by the running task, or -1
+int8_t findBuffer(void *base)
+{
+    int8_t b;
+    for (b = 0; b < MAX_BUFFERS; b++)
+    {
+        if (base != NULL && buffers[b].base == base
+                && buffers[b].owner == taskCurrent)
+        {
+            return b;
+        }
+    }
+    return -1;
+}
+
+// allocates heap and opens it to the running task only
+void* bufferAllocKernel(uint32_t size)
+{
+    uint8_t b = 0;
+    while (b < MAX_BUFFERS && buffers[b].base != NULL)
+    {
+        b++;
+    }
+    if (b == MAX_BUFFERS)
+    {
+        return NULL;
+    }
+    buffers[b].base = mallocHeap(size);
+    if (buffers[b].base != NULL)
+    {
+        buffers[b].size = size;
+        buffers[b].owner = taskCurrent;
+        addSramAccessWindow(&tcb[taskCurrent].srd, buffers[b].base, size);
+    }
+    // mallocHeap leaves the mpu on its own mask
+    applyTaskAccess();
+    return buffers[b].base;
+}
+
+// hands a buffer to another task, the data stays where it is and only the
+// srd bits move, so the sender faults if it touches the buffer afterwards
+bool bufferTransferKernel(void *base, uint8_t task)
+{
+    int8_t b = findBuffer(base);
+    if (b < 0 || task >= MAX_TASKS || tcb[task].state == STATE_INVALID
+            || tcb[task].state == STATE_KILLED)
+    {
+        return false;
+    }
+    revokeSramAccessWindow(&tcb[taskCurrent].srd, base, buffers[b].size);
+    addSramAccessWindow(&tcb[task].srd, base, buffers[b].size);
+    buffers[b].owner = task;
+    applyTaskAccess();
+    return true;
+}
+
+void bufferRelease(uint8_t b)
+{
+    revokeSramAccessWindow(&tcb[buffers[b].owner].srd, buffers[b].base,
+                           buffers[b].size);
+    freeHeap(buffers[b].base);
+    buffers[b].base = NULL;
+}
+
+bool bufferFreeKernel(void *base)
+{
+    int8_t b = findBuffer(base);
+    if (b < 0)
+    {
+        return false;
+    }
+    bufferRelease(b);
+    applyTaskAccess();
+    return true;
+}
+
+// returns the slot of a shared region, or -1
+int16_t findShm(const char name[])
+{
+    uint8_t i;
+    for (i = 0; i < shmPool.count; i++)
+    {
+        if (strcmp(shms[shmOrder[i]].name, name) == 0)
+        {
+            return shmOrder[i];
+        }
+    }
+    return -1;
+}
+
+// moves a task between no, read only and read write access to a region
+bool shmSetAccess(uint8_t r, uint8_t task, uint8_t access)
+{
+    uint16_t bit = 1 << task;
+    if (access == SHM_READ && !(shms[r].readers & bit))
+    {
+        // fails when the task already reads a region in another 8 KiB
+        if (!addSramReadWindow(&tcb[task].readSrd, shms[r].base, shms[r].size))
+        {
+            return false;
+        }
+        shms[r].readers |= bit;
+    }
+    else if (access != SHM_READ && (shms[r].readers & bit))
+    {
+        revokeSramAccessWindow(&tcb[task].readSrd, shms[r].base, shms[r].size);
+        shms[r].readers &= ~bit;
+    }
+    if (access == SHM_WRITE && !(shms[r].writers & bit))
+    {
+        addSramAccessWindow(&tcb[task].srd, shms[r].base, shms[r].size);
+        shms[r].writers |= bit;
+    }
+    else if (access != SHM_WRITE && (shms[r].writers & bit))
+    {
+        revokeSramAccessWindow(&tcb[task].srd, shms[r].base, shms[r].size);
+        shms[r].writers &= ~bit;
+    }
+    return true;
+}
+
+// allocates a named region the running task can read and write
+// names must fit SHM_NAME_SIZE, a truncated one could never be opened
+handle shmCreateKernel(const char name[], uint32_t size)
+{
+    int16_t r;
+    if (strlen(name) >= SHM_NAME_SIZE || findShm(name) >= 0)
+    {
+        return INVALID_HANDLE;
+    }
+    r = poolAlloc(&shmPool);
+    if (r < 0)
+    {
+        return INVALID_HANDLE;
+    }
+    shms[r].base = mallocHeap(size);
+    if (shms[r].base == NULL)
+    {
+        poolFree(&shmPool, r);
+        applyTaskAccess();
+        return INVALID_HANDLE;
+    }
+    strcpy(shms[r].name, name);
+    shms[r].size = size;
+    shms[r].owner = taskCurrent;
+    shms[r].readers = 0;
+    shms[r].writers = 0;
+    shmSetAccess(r, taskCurrent, SHM_WRITE);
+    applyTaskAccess();
+    return poolHandle(&shmPool, r);
+}
+
+// revokes every grant and returns the region to the heap
+void shmRelease(uint8_t r)
+{
+    uint8_t i;
+    for (i = 0; i < MAX_TASKS; i++)
+    {
+        shmSetAccess(r, i, SHM_NONE);
+    }
+    freeHeap(shms[r].base);
+    poolFree(&shmPool, r);
+}
+
+bool shmDeleteKernel(handle region)
+{
+    int16_t r = poolLookup(&shmPool, region);
+    if (r < 0 || shms[r].owner != taskCurrent)
+    {
+        return false;
+    }
+    shmRelease(r);
+    applyTaskAccess();
+    return true;
+}
+
+// only the owner grants, and it always keeps read write access itself
+bool shmGrantKernel(handle region, uint8_t task, uint8_t access)
+{
+    int16_t r = poolLookup(&shmPool, region);
+    if (r < 0 || shms[r].owner != taskCurrent || task >= MAX_TASKS
+            || task == taskCurrent || tcb[task].state == STATE_INVALID
+            || tcb[task].state == STATE_KILLED || access > SHM_WRITE)
+    {
+        return false;
+    }
+    return shmSetAccess(r, task, access);
+}
+
+// the base is only handed to tasks that were granted access
+void* shmBaseKernel(handle region)
+{
+    int16_t r = poolLookup(&shmPool, region);
+    if (r < 0 || !((shms[r].readers | shms[r].writers) & (1 << taskCurrent)))
+    {
+        return NULL;
+    }
+    return shms[r].base;
+}
+
+handle createTopicKernel(uint8_t sampleSize)
+{
+    int16_t t;
+    if (sampleSize == 0 || sampleSize > MAX_TOPIC_SAMPLE)
+    {
+        return INVALID_HANDLE;
+    }
+    t = poolAlloc(&topicPool);
+    if (t < 0)
+    {
+        return INVALID_HANDLE;
+    }
+    topics[t].sampleSize = sampleSize;
+    topics[t].sequence = 0;
+    topics[t].subscriberCount = 0;
+    topics[t].waiting = 0;
+    return poolHandle(&topicPool, t);
+}
+
+bool deleteTopicKernel(handle tp)
+{
+    int16_t t = poolLookup(&topicPool, tp);
+    if (t < 0 || topics[t].waiting != 0)
+    {
+        return false;
+    }
+    poolFree(&topicPool, t);
+    return true;
+}
+
+// returns the subscriber slot of a task, or -1
+int8_t findSubscriber(uint8_t t, uint8_t task)
+{
+    int8_t i;
+    for (i = 0; i < topics[t].subscriberCount; i++)
+    {
+        if (topics[t].subscribers[i] == task)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// a new subscriber only sees samples published after it subscribed
+bool subscribeKernel(handle tp)
+{
+    int16_t t = poolLookup(&topicPool, tp);
+    if (t < 0 || findSubscriber(t, taskCurrent) >= 0
+            || topics[t].subscriberCount == MAX_TOPIC_SUBSCRIBERS)
+    {
+        return false;
+    }
+    topics[t].subscribers[topics[t].subscriberCount] = taskCurrent;
+    topics[t].cursors[topics[t].subscriberCount] = topics[t].sequence;
+    topics[t].subscriberCount++;
+    return true;
+}
+
+void topicRemove(uint8_t t, uint8_t task)
+{
+    int8_t i = findSubscriber(t, task);
+    if (i < 0)
+    {
+        return;
+    }
+    for (; i < topics[t].subscriberCount - 1; i++)
+    {
+        topics[t].subscribers[i] = topics[t].subscribers[i + 1];
+        topics[t].cursors[i] = topics[t].cursors[i + 1];
+    }
+    topics[t].subscriberCount--;
+    topics[t].waiting &= ~(1 << task);
+}
+
+bool unsubscribeKernel(handle tp)
+{
+    int16_t t = poolLookup(&topicPool, tp);
+    if (t < 0 || findSubscriber(t, taskCurrent) < 0)
+    {
+        return false;
+    }
+    topicRemove(t, taskCurrent);
+    return true;
+}
+
+#define TOPIC_RETRY 2              // a woken topicRead repeats the svc
+
+// stores one copy of the sample; every subscriber reads it later through
+// its own cursor
+bool publishKernel(handle tp, const void *sample)
+{
+    int16_t t = poolLookup(&topicPool, tp);
+    uint8_t *slot;
+    uint8_t i;
+    uint8_t task;
+    if (t < 0)
+    {
+        return false;
+    }
+    slot = topics[t].samples[topics[t].sequence % TOPIC_HISTORY];
+    copyMessage(slot, sample, topics[t].sampleSize, MAX_TOPIC_SAMPLE);
+    topics[t].sequence++;
+
+    // blocked subscribers are only woken, their cursors still point at this
+    // sample and topicRead copies it from the ring, so publish does not
+    // grow with the number of readers
+    for (i = 0; topics[t].waiting != 0 && i < topics[t].subscriberCount; i++)
+    {
+        task = topics[t].subscribers[i];
+        if (topics[t].waiting & (1 << task))
+        {
+            topics[t].waiting &= ~(1 << task);
+            setStackedR0(task, TOPIC_RETRY);
+            wakeTask(task, TRACE_WAKE_TOPIC);
+        }
+    }
+    return true;
+}
+
+// returns 1 with a sample, 0 if there was none and TOPIC_NOWAIT was given,
+// or -1 if the caller is not subscribed
+// a subscriber more than TOPIC_HISTORY behind skips to the oldest sample kept
+int8_t topicReadKernel(handle tp, void *sample, uint8_t mode)
+{
+    int16_t t = poolLookup(&topicPool, tp);
+    int8_t i;
+    uint32_t *cursor;
+    if (t < 0 || (i = findSubscriber(t, taskCurrent)) < 0)
+    {
+        return -1;
+    }
+    cursor = &topics[t].cursors[i];
+    if (*cursor == topics[t].sequence)
+    {
+        if (mode & TOPIC_NOWAIT)
+        {
+            return 0;
+        }
+        topics[t].waiting |= 1 << taskCurrent;
+        tcb[taskCurrent].state = STATE_BLOCKED_TOPIC;
+        tcb[taskCurrent].blockedAt = DWT_CYCCNT_R;
+        triggerPendSvFault();
+        return -1;
+    }
+    if (mode & TOPIC_LATEST)
+    {
+        *cursor = topics[t].sequence - 1;
+    }
+    else if (topics[t].sequence - *cursor > TOPIC_HISTORY)
+    {
+        *cursor = topics[t].sequence - TOPIC_HISTORY;
+    }
+    copyMessage(sample, topics[t].samples[*cursor % TOPIC_HISTORY],
+                topics[t].sampleSize, MAX_TOPIC_SAMPLE);
+    (*cursor)++;
+    return 1;
+}
+
+// trigger is the number of bytes a blocked read waits for
+handle createStreamKernel(uint8_t trigger)
+{
+    int16_t st;
+    if (trigger == 0 || trigger > STREAM_SIZE)
+    {
+        return INVALID_HANDLE;
+    }
+    st = poolAlloc(&streamPool);
+    if (st < 0)
+    {
+        return INVALID_HANDLE;
+    }
+    streams[st].head = 0;
+    streams[st].count = 0;
+    streams[st].trigger = trigger;
+    streams[st].reader = MAX_TASKS;
+    streams[st].writers = 0;
+    return poolHandle(&streamPool, st);
+}
+
+bool deleteStreamKernel(handle sb)
+{
+    int16_t st = poolLookup(&streamPool, sb);
+    if (st < 0 || streams[st].reader < MAX_TASKS || streams[st].writers != 0)
+    {
+        return false;
+    }
+    poolFree(&streamPool, st);
+    return true;
+}
+
+// copies as much as fits into the ring, returns the bytes copied
+uint8_t streamPut(uint8_t st, const uint8_t *data, uint8_t size)
+{
+    uint8_t n = 0;
+    while (n < size && streams[st].count < STREAM_SIZE)
+    {
+        streams[st].data[(streams[st].head + streams[st].count) % STREAM_SIZE] =
+                data[n++];
+        streams[st].count++;
+    }
+    return n;
+}
+
+uint8_t streamGet(uint8_t st, uint8_t *data, uint8_t size)
+{
+    uint8_t n = 0;
+    while (n < size && streams[st].count > 0)
+    {
+        data[n++] = streams[st].data[streams[st].head];
+        streams[st].head = (streams[st].head + 1) % STREAM_SIZE;
+        streams[st].count--;
+    }
+    return n;
+}
+
+// moves the rest of blocked writes into space a read has freed
+void streamWakeWriters(uint8_t st)
+{
+    uint8_t i;
+    uint8_t n;
+    for (i = 0; streams[st].writers != 0 && streams[st].count < STREAM_SIZE
+            && i < MAX_TASKS; i++)
+    {
+        if (streams[st].writers & (1 << i))
+        {
+            n = streamPut(st, tcb[i].streamData, tcb[i].streamSize);
+            tcb[i].streamData += n;
+            tcb[i].streamSize -= n;
+            tcb[i].streamDone += n;
+            if (tcb[i].streamSize == 0)
+            {
+                streams[st].writers &= ~(1 << i);
+                setStackedR0(i, tcb[i].streamDone);
+                wakeTask(i, TRACE_WAKE_STREAM);
+            }
+        }
+    }
+}
+
+// hands a blocked reader its data once the trigger level is buffered
+// the uart rx isr lands here, often before pendSvIsr has switched the reader
+// out, so the count goes through setStackedR0 rather than the saved sp
+void streamWakeReader(uint8_t st)
+{
+    uint8_t task = streams[st].reader;
+    uint8_t level;
+    if (task == MAX_TASKS)
+    {
+        return;
+    }
+    level = streams[st].trigger;
+    if (level > tcb[task].streamSize)
+    {
+        level = tcb[task].streamSize;
+    }
+    if (streams[st].count >= level)
+    {
+        setStackedR0(task, streamGet(st, tcb[task].streamData,
+                                     tcb[task].streamSize));
+        streams[st].reader = MAX_TASKS;
+        wakeTask(task, TRACE_WAKE_STREAM);
+        streamWakeWriters(st);
+    }
+}
+
+// blocks until every byte is in the ring, returns the bytes written
+uint8_t streamWriteKernel(handle sb, const uint8_t *data, uint8_t size)
+{
+    int16_t st = poolLookup(&streamPool, sb);
+    uint8_t n;
+    if (st < 0)
+    {
+        return 0;
+    }
+    n = streamPut(st, data, size);
+    streamWakeReader(st);
+    n += streamPut(st, data + n, size - n);
+    if (n < size)
+    {
+        tcb[taskCurrent].streamData = (uint8_t*) data + n;
+        tcb[taskCurrent].streamSize = size - n;
+        tcb[taskCurrent].streamDone = n;
+        streams[st].writers |= 1 << taskCurrent;
+        tcb[taskCurrent].state = STATE_BLOCKED_STREAM;
+        tcb[taskCurrent].blockedAt = DWT_CYCCNT_R;
+        triggerPendSvFault();
+    }
+    return n;
+}
+
+// returns what is buffered if the trigger level is met, or block is false;
+// otherwise blocks until it is met, only one reader may wait at a time
+uint8_t streamReadKernel(handle sb, uint8_t *buffer, uint8_t size, bool block)
+{
+    int16_t st = poolLookup(&streamPool, sb);
+    uint8_t n;
+    uint8_t level;
+    if (st < 0 || size == 0 || streams[st].reader < MAX_TASKS)
+    {
+        return 0;
+    }
+    level = (streams[st].trigger < size) ? streams[st].trigger : size;
+    if (streams[st].count >= level || !block)
+    {
+        n = streamGet(st, buffer, size);
+        streamWakeWriters(st);
+        return n;
+    }
+    streams[st].reader = taskCurrent;
+    tcb[taskCurrent].streamData = buffer;
+    tcb[taskCurrent].streamSize = size;
+    tcb[taskCurrent].state = STATE_BLOCKED_STREAM;
+    tcb[taskCurrent].blockedAt = DWT_CYCCNT_R;
+    triggerPendSvFault();
+    return 0;
+}
+
+handle createQueueKernel(uint8_t messageSize)
+{
+    int16_t q;
+    uint8_t i;
+    if (messageSize == 0 || messageSize > QUEUE_MESSAGE_SIZE)
+    {
+        return INVALID_HANDLE;
+    }
+    q = poolAlloc(&queuePool);
+    if (q < 0)
+    {
+        return INVALID_HANDLE;
+    }
+    queues[q].messageSize = messageSize;
+    queues[q].count = 0;
+    queues[q].sequence = 0;
+    queues[q].senders = 0;
+    queues[q].receivers = 0;
+    for (i = 0; i < QUEUE_LENGTH; i++)
+    {
+        queues[q].slots[i] = i;
+    }
+    return poolHandle(&queuePool, q);
+}
+
+bool deleteQueueKernel(handle mq)
+{
+    int16_t q = poolLookup(&queuePool, mq);
+    if (q < 0 || queues[q].senders != 0 || queues[q].receivers != 0)
+    {
+        return false;
+    }
+    poolFree(&queuePool, q);
+    return true;
+}
+
+// true if slot a should be received before slot b
+bool queueBefore(msgQueue *mq, uint8_t a, uint8_t b)
+{
+    return mq->priority[a] < mq->priority[b]
+            || (mq->priority[a] == mq->priority[b]
+                    && (int16_t) (mq->order[a] - mq->order[b]) < 0);
+}
+
+// adds a message in O(log n), the queue must not be full
+void queuePush(msgQueue *mq, const void *message, uint8_t priority)
+{
+    uint8_t i = mq->count;
+    uint8_t slot = mq->slots[i];
+    uint8_t parent;
+    copyMessage(mq->data[slot], message, mq->messageSize, QUEUE_MESSAGE_SIZE);
+    mq->priority[slot] = priority;
+    mq->order[slot] = mq->sequence++;
+    mq->count++;
+    while (i > 0)
+    {
+        parent = (i - 1) / 2;
+        if (!queueBefore(mq, slot, mq->slots[parent]))
+        {
+            break;
+        }
+        mq->slots[i] = mq->slots[parent];
+        i = parent;
+    }
+    mq->slots[i] = slot;
+}
+
+// removes the most urgent message in O(log n), the queue must not be empty
+void queuePop(msgQueue *mq, void *message, uint8_t *priority)
+{
+    uint8_t top = mq->slots[0];
+    uint8_t last;
+    uint8_t i = 0;
+    uint8_t child;
+    copyMessage(message, mq->data[top], mq->messageSize, QUEUE_MESSAGE_SIZE);
+    if (priority != NULL)
+    {
+        *priority = mq->priority[top];
+    }
+    mq->count--;
+    last = mq->slots[mq->count];
+    while ((child = 2 * i + 1) < mq->count)
+    {
+        if (child + 1 < mq->count
+                && queueBefore(mq, mq->slots[child + 1], mq->slots[child]))
+        {
+            child++;
+        }
+        if (!queueBefore(mq, mq->slots[child], last))
+        {
+            break;
+        }
+        mq->slots[i] = mq->slots[child];
+        i = child;
+    }
+    mq->slots[i] = last;
+    // the freed slot goes just past the heap
+    mq->slots[mq->count] = top;
+}
+
+// most important task in a set, or MAX_TASKS if it is empty
+uint8_t highestPriorityTask(uint16_t tasks)
+{
+    uint8_t i;
+    uint8_t best = MAX_TASKS;
+    for (i = 0; i < MAX_TASKS; i++)
+    {
+        if ((tasks & (1 << i)) && (best == MAX_TASKS
+                || tcb[i].currentPriority < tcb[best].currentPriority))
+        {
+            best = i;
+        }
+    }
+    return best;
+}
+
+void queueBlock(uint8_t q, uint32_t timeout)
+{
+    tcb[taskCurrent].queue = q;
+    tcb[taskCurrent].ticks = (timeout == QUEUE_FOREVER) ? 0 : timeout;
+    tcb[taskCurrent].state = STATE_BLOCKED_QUEUE;
+    tcb[taskCurrent].blockedAt = DWT_CYCCNT_R;
+    triggerPendSvFault();
+}
+
+// the false left in r0 when the task blocked is its result
+void queueTimeout(uint8_t task)
+{
+    queues[tcb[task].queue].senders &= ~(1 << task);
+    queues[tcb[task].queue].receivers &= ~(1 << task);
+    wakeTask(task, TRACE_WAKE_TIMEOUT);
+}
+
+// a receiver waiting on an empty queue gets the message directly
+bool queueSendKernel(handle mq, const void *message, uint8_t priority,
+                     uint32_t timeout)
+{
+    int16_t q = poolLookup(&queuePool, mq);
+    uint8_t task;
+    if (q < 0)
+    {
+        return false;
+    }
+    task = highestPriorityTask(queues[q].receivers);
+    if (task < MAX_TASKS)
+    {
+        copyMessage(tcb[task].queueData, message, queues[q].messageSize,
+                    QUEUE_MESSAGE_SIZE);
+        if (tcb[task].queuePriorityOut != NULL)
+        {
+            *tcb[task].queuePriorityOut = priority;
+        }
+        queues[q].receivers &= ~(1 << task);
+        setStackedR0(task, true);
+        wakeTask(task, TRACE_WAKE_QUEUE);
+        return true;
+    }
+    if (queues[q].count < QUEUE_LENGTH)
+    {
+        queuePush(&queues[q], message, priority);
+        return true;
+    }
+    if (timeout != QUEUE_NOWAIT)
+    {
+        tcb[taskCurrent].queueData = (void*) message;
+        tcb[taskCurrent].queuePriority = priority;
+        queues[q].senders |= 1 << taskCurrent;
+        queueBlock(q, timeout);
+    }
+    return false;
+}
+
+// the space freed by a receive goes to the most important blocked sender
+bool queueReceiveKernel(handle mq, void *message, uint8_t *priority,
+                        uint32_t timeout)
+{
+    int16_t q = poolLookup(&queuePool, mq);
+    uint8_t task;
+    if (q < 0)
+    {
+        return false;
+    }
+    if (queues[q].count > 0)
+    {
+        queuePop(&queues[q], message, priority);
+        task = highestPriorityTask(queues[q].senders);
+        if (task < MAX_TASKS)
+        {
+            queuePush(&queues[q], tcb[task].queueData, tcb[task].queuePriority);
+            queues[q].senders &= ~(1 << task);
+            setStackedR0(task, true);
+            wakeTask(task, TRACE_WAKE_QUEUE);
+        }
+        return true;
+    }
+    if (timeout != QUEUE_NOWAIT)
+    {
+        tcb[taskCurrent].queueData = message;
+        tcb[taskCurrent].queuePriorityOut = priority;
+        queues[q].receivers |= 1 << taskCurrent;
+        queueBlock(q, timeout);
+    }
+    return false;
+}
+
+// takes a count or blocks the running task on the semaphore
+void waitKernel(uint8_t s)
+{
+    if (semaphores[s].count == 0)
+    {
+        semaphores[s].processQueue[semaphores[s].queueSize] = taskCurrent;
+        semaphores[s].queueSize++;
+        tcb[taskCurrent].state = STATE_BLOCKED_SEMAPHORE;
+        tcb[taskCurrent].semaphore = s;
+        tcb[taskCurrent].blockedAt = DWT_CYCCNT_R;
+        semaphores[s].stats.contentions++;
+        triggerPendSvFault();
+    }
+    else
+    {
+        semaphores[s].count--;
+        semaphores[s].stats.acquisitions++;
+    }
+}
+
+// log2 bucket of a latency in cycles, bucket 0 is below 2^LATENCY_MIN_SHIFT
+uint8_t latencyBucket(uint32_t cycles)
+{
+    uint8_t bucket = 0;
+    cycles >>= LATENCY_MIN_SHIFT;
+    while (cycles != 0 && bucket < LATENCY_BUCKETS - 1)
+    {
+        cycles >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+// called on dispatch, charges wake-to-run time to the task's histogram
+void recordWakeLatency(uint8_t task)
+{
+    if (tcb[task].wakePending)
+    {
+        uint32_t latency = DWT_CYCCNT_R - tcb[task].wokenAt;
+        LatencyInfo *info = &tcb[task].latency;
+        uint8_t bucket = latencyBucket(latency);
+
+        tcb[task].wakePending = false;
+        info->count++;
+        if (latency > info->max)
+        {
+            info->max = latency;
+        }
+        if (info->buckets[bucket] != 0xFFFF)
+        {
+            info->buckets[bucket]++;
+        }
+    }
+}
+
+// REQUIRED: Implement prioritization to NUM_PRIORITIES
+uint8_t rtosScheduler(void)
+{
+    bool ok;
+    static uint8_t task = 0xFF;
+    ok = false;
+    if (priorityScheduler)
+    {
+        uint8_t highestPrio = 255;
+        uint8_t start = (taskCurrent + 1) % MAX_TASKS;
+        int i = start;
+        task = 0;
+        // a message handoff wins ties, but never beats a more important task
+        if (handoffTask < MAX_TASKS && tcb[handoffTask].state == STATE_READY)
+        {
+            task = handoffTask;
+            highestPrio = tcb[task].currentPriority;
+        }
+        do
+        {
+            if (tcb[i].state == STATE_READY || tcb[i].state == STATE_UNRUN)
+            {
+                if (tcb[i].currentPriority < highestPrio) // Check dynamic priority
+                {
+                    task = i;
+                    highestPrio = tcb[task].currentPriority;
+                }
+            }
+            i = (i + 1) % MAX_TASKS; // wrap around to not pick current task for next task
+        }
+        while (i != start);
+        ok = true;
+    }
+    else if (handoffTask < MAX_TASKS && tcb[handoffTask].state == STATE_READY)
+    {
+        task = handoffTask;
+    }
+    else
+    {
+        while (!ok)
+        {
+            task++;
+            if (task >= MAX_TASKS)
+                task = 0;
+            ok = (tcb[task].state == STATE_READY
+                    || tcb[task].state == STATE_UNRUN);
+        }
+    }
+
+    if (task == 0xFF)
+    {
+        task = 0;
+    }
+    handoffTask = MAX_TASKS;
+
+    if (tcb[task].state == STATE_UNRUN)
+    {
+        tcb[task].state = STATE_READY;
+    }
+
+    return task;
+}
+
+// REQUIRED: modify this function to start the operating system
+// by calling scheduler, set srd bits, setting PSP, ASP bit, call fn with fn add in R0
+// fn set TMPL bit, and PC <= fn
+void startRtos(void)
+{
+    taskCurrent = rtosScheduler();
+    tcb[taskCurrent].state = STATE_READY;
+    shared.taskCurrent = taskCurrent;
+    shared.priv = tcb[taskCurrent].priv;
+
+    // apply MPU settings to task
+    applyTaskAccess();
+    lastCycleCount = DWT_CYCCNT_R;
+
+    uint32_t *psp = tcb[taskCurrent].sp;
+    setPsp(psp);
+    setAspBit();
+    if (!tcb[taskCurrent].privileged)
+    {
+        setTMPL();
+    }
+    setPC((uint32_t) tcb[taskCurrent].arg, (uint32_t) tcb[taskCurrent].fn);
+}
+
+// REQUIRED:
+// add task if room in task list
+// store the thread name
+// allocate stack space and store top of stack in sp and spInit
+// set the srd bits based on the memory allocation
+bool createThread(_fn fn, const char name[], uint8_t priority,
+                  uint32_t stackBytes)
+{
+    return createThreadArg(fn, NULL, name, priority, stackBytes);
+}
+
+// the task is identified by its pid, so one fn can back several tasks, each
+// started with its own arg in r0
+bool createThreadArg(_fn fn, void *arg, const char name[], uint8_t priority,
+                     uint32_t stackBytes)
+{
+    bool ok = false;
+    uint8_t i = 0;
+    if (taskCount < MAX_TASKS)
+    {
+        // find first available tcb record
+        while (tcb[i].state != STATE_INVALID)
+        {
+            i++;
+            if (i >= MAX_TASKS)
+            {
+                // No available space in the tcb
+                return false;
+            }
+        }
 
-// REQUIRED: modify this function to unlock a mutex using pendsv
-void unlock(int8_t mutex)
+        // allocate memory for the process
+        void *stack = mallocHeap(stackBytes);
+        if (stack == NULL)
+        {
+            return false;
+        }
+        tcb[i].stackBase = stack;
+
+        // set srd bits for tcb
+        tcb[i].srd = createNoSramAccessMask();
+        tcb[i].readSrd = createNoSramAccessMask();
+        addSramAccessWindow(&tcb[i].srd, (uint32_t*) stack, stackBytes);
+
+        // set stack pointer dummy variables
+        uint32_t *sp = initTaskPrivate(i, stack, stackBytes);
+        *(--sp) = 0x01000000;     // xPSR
+        *(--sp) = (uint32_t) fn;  // PC
+        *(--sp) = 0xFFFFFFFD;     // LR
+        *(--sp) = 0x12121212;     // R12
+        *(--sp) = 0x03030303;     // R3
+        *(--sp) = 0x02020202;     // R2
+        *(--sp) = 0x01010101;     // R1
+        *(--sp) = (uint32_t) arg; // R0
+        *(--sp) = 0x11111111;     // R11
+        *(--sp) = 0x10101010;     // R10
+        *(--sp) = 0x09090909;     // R9
+        *(--sp) = 0x08080808;     // R8
+        *(--sp) = 0x07070707;     // R7
+        *(--sp) = 0x06060606;     // R6
+        *(--sp) = 0x05050505;     // R5
+        *(--sp) = 0x04040404;     // R4
+        tcb[i].sp = sp;
+        // set tcb properties
+        tcb[i].state = STATE_UNRUN;
+        tcb[i].pid = nextPid++;
+        tcb[i].fn = fn;
+        tcb[i].arg = arg;
+        strncpy(tcb[i].name, name, sizeof(tcb[i].name));
+        tcb[i].priority = priority;
+        tcb[i].currentPriority = priority;
+        tcb[i].notifyValue = 0;
+        tcb[i].notifyPending = false;
+        tcb[i].privileged = false;
+        tcb[i].msgSenders = 0;
+        resetCpuUsage(i);
+
+        // increment task count
+        taskCount++;
+        ok = true;
+    }
+    return ok;
+}
+
+// returns the tcb index of a thread, or -1
+// kernel side, for use before startRtos or from handler mode
+int8_t getTaskIndex(_fn fn)
+{
+    int8_t i;
+    for (i = 0; i < MAX_TASKS; i++)
+    {
+        if (tcb[i].fn == fn && tcb[i].state != STATE_INVALID)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// lets a kernel task run privileged, call before startRtos
+// applies to every task created from fn
+bool setThreadPrivileged(_fn fn, bool on)
+{
+    bool found = false;
+    uint8_t i;
+    for (i = 0; i < MAX_TASKS; i++)
+    {
+        if (tcb[i].fn == fn && tcb[i].state != STATE_INVALID)
+        {
+            tcb[i].privileged = on;
+            found = true;
+        }
+    }
+    return found;
+}
+
+// REQUIRED: modify this function to kill a thread
+// REQUIRED: free memory, remove any pending semaphore waiting,
+//           unlock any mutexes, mark state as killed
+void killThread(_fn fn)
+{
+    __asm(" SVC #6 ");
+}
+
+void destroyThread(uint32_t pid)
+{
+    __asm(" SVC #6 ");
+}
+
+// REQUIRED: modify this function to restart a thread, including creating a stack
+void restartThread(_fn fn)
+{
+    __asm(" SVC #11 ");
+}
+void restartThreadKernel(_fn fn)
+{
+    int i;
+    // several tasks may share fn, restart the first one that is not running
+    for (i = 0; i < MAX_TASKS; i++)
+    {
+        if (tcb[i].fn == fn && (tcb[i].state == STATE_KILLED
+                || tcb[i].state == STATE_UNRUN))
+        {
+            restartTaskKernel(i);
+            break;
+        }
+    }
+}
+
+// restarts by tcb index, so tasks sharing a fn come back with their own arg
+void restartTaskKernel(uint8_t taskIndex)
+{
+    if (taskIndex < MAX_TASKS
+            && (tcb[taskIndex].state == STATE_KILLED
+                    || tcb[taskIndex].state == STATE_UNRUN))
+    {
+        _fn fn = tcb[taskIndex].fn;
+        uint32_t stackBytes = 1024;
+        void *stack = mallocHeap(stackBytes);
+        if (stack == NULL)
+        {
+            return;
+        }
+
+        tcb[taskIndex].stackBase = stack;
+
+        tcb[taskIndex].srd = createNoSramAccessMask();
+        tcb[taskIndex].readSrd = createNoSramAccessMask();
+        addSramAccessWindow(&tcb[taskIndex].srd, (uint32_t*) stack, stackBytes);
+
+        uint32_t *sp = initTaskPrivate(taskIndex, stack, stackBytes);
+        *(--sp) = 0x01000000;     // xPSR
+        *(--sp) = (uint32_t) fn;  // PC
+        *(--sp) = 0xFFFFFFFD;     // LR
+        *(--sp) = 0x12121212;     // R12
+        *(--sp) = 0x03030303;     // R3
+        *(--sp) = 0x02020202;     // R2
+        *(--sp) = 0x01010101;     // R1
+        *(--sp) = (uint32_t) tcb[taskIndex].arg; // R0
+        *(--sp) = 0x11111111;     // R11
+        *(--sp) = 0x10101010;     // R10
+        *(--sp) = 0x09090909;     // R9
+        *(--sp) = 0x08080808;     // R8
+        *(--sp) = 0x07070707;     // R7
+        *(--sp) = 0x06060606;     // R6
+        *(--sp) = 0x05050505;     // R5
+        *(--sp) = 0x04040404;     // R4
+
+        tcb[taskIndex].sp = sp;
+        tcb[taskIndex].notifyValue = 0;
+        tcb[taskIndex].notifyPending = false;
+        resetCpuUsage(taskIndex);
+
+        // Reset State
+        tcb[taskIndex].state = STATE_READY;
+
+    }
+}
+
+// REQUIRED: modify this function to set a thread priority
+void setThreadPriority(_fn fn, uint8_t priority)
+{
+    __asm(" SVC #14 ");
+}
+
+// REQUIRED: modify this function to yield execution back to scheduler using pendsv
+void yield(void)
+{
+    __asm(" SVC #0 ");
+}
+
+// defers preemption without an svc, interrupts stay enabled
+// calls nest, and the task may still block or yield while holding it
+void schedLock(void)
+{
+    shared.priv->schedDepth++;
+}
+
+// the final unlock performs any switch that was deferred
+void schedUnlock(void)
+{
+    taskPrivate *priv = shared.priv;
+    if (priv->schedDepth > 0)
+    {
+        priv->schedDepth--;
+        if (priv->schedDepth == 0 && priv->schedPending)
+        {
+            priv->schedPending = false;
+            yield();
+        }
+    }
+}
+
+// REQUIRED: modify this function to support 1ms system timer
+// execution yielded back to scheduler until time elapses using pendsv
+void sleep(uint32_t tick)
+{
+    __asm(" SVC #1 ");
+}
+
+// REQUIRED: modify this function to wait a semaphore using pendsv
+// returns false at once for a bad handle, the semaphore was not taken
+bool wait(handle semaphore)
+{
+    __asm(" SVC #4 ");
+}
+
+// REQUIRED: modify this function to signal a semaphore is available using pendsv
+// returns false for a bad handle
+bool post(handle semaphore)
+{
+    __asm(" SVC #5 ");
+}
+
+bool lockSvc(handle mutex)
+{
+    __asm(" SVC #2 ");
+}
+
+void unlockSvc(handle mutex)
 {
     __asm(" SVC #3 ");
 }
 
+// true if the running task owns this recursive mutex
+// the record is in the task's own private block, written by the kernel
+bool ownsRecursiveMutex(handle mutex)
+{
+    uint8_t slot = HANDLE_SLOT(mutex);
+    return slot < MAX_MUTEXES && mutex != INVALID_HANDLE
+            && shared.priv->mutexHeld[slot] == mutex;
+}
+
+// REQUIRED: modify this function to lock a mutex using pendsv
+// the owner of a recursive mutex re-enters it without an svc
+// returns false for a bad handle or a re-entry past MAX_MUTEX_DEPTH
+bool lock(handle mutex)
+{
+    if (ownsRecursiveMutex(mutex))
+    {
+        uint8_t slot = HANDLE_SLOT(mutex);
+        if (shared.priv->mutexDepth[slot] >= MAX_MUTEX_DEPTH)
+        {
+            return false;
+        }
+        shared.priv->mutexDepth[slot]++;
+        return true;
+    }
+    return lockSvc(mutex);
+}
+
+// REQUIRED: modify this function to unlock a mutex using pendsv
+// only the last unlock of a recursive mutex releases it
+void unlock(handle mutex)
+{
+    if (ownsRecursiveMutex(mutex) && shared.priv->mutexDepth[HANDLE_SLOT(mutex)] > 0)
+    {
+        shared.priv->mutexDepth[HANDLE_SLOT(mutex)]--;
+    }
+    else
+    {
+        unlockSvc(mutex);
+    }
+}
+
 void testSRAMpriv()
 {
     uint32_t *pointers[12];
@@ -429,6 +2431,12 @@ void testSRAMunprivFree()
 }
 
 void printPid(int newlines)
+{
+    printTaskPid(tcb[taskCurrent].pid, newlines);
+}
+
+// deferred fault reports name the pid captured when the fault happened
+void printTaskPid(uint32_t pid, int newlines)
 {
     // String of size 12 for 10 digits (4,294,967,295) + 1 sign + 1 null terminator
     char pidStr[12];
@@ -445,27 +2453,20 @@ void printPid(int newlines)
 // REQUIRED: in preemptive code, add code to request task switch
 void systickIsr(void)
 {
-    tcb[taskCurrent].time++;
-    /**/
-    tcb[taskCurrent].recentTicks++;
-    totalWindowTicks++;
-
-    if (totalWindowTicks >= 1000)
+    uint32_t basepri = enterCritical();
+    traceRecord(TRACE_TICK, taskCurrent, 0);
+    profileSample(getPsp());
+
+    // close the epoch: charge the running task so its cycles land in the
+    // epoch they were spent in, other tasks fold lazily when next touched
+    epochTicks++;
+    if (epochTicks >= TICKS_PER_EPOCH)
     {
-        int i;
-        for (i = 0; i < MAX_TASKS; i++)
-        {
-            if (tcb[i].state != STATE_INVALID)
-            {
-                tcb[i].usage = tcb[i].recentTicks * 10;
-                tcb[i].recentTicks = 0;
-            }
-        }
-        totalWindowTicks = 0;
+        chargeCpuCycles();
+        cpuEpoch++;
+        epochTicks = 0;
     }
 
-    /**/
-
     int i = 0;
     for (i = 0; i < MAX_TASKS; i++)
     {
@@ -474,15 +2475,26 @@ void systickIsr(void)
             tcb[i].ticks--;
             if (tcb[i].ticks == 0)
             {
-                tcb[i].state = STATE_READY;
+                wakeTask(i, TRACE_WAKE_SLEEP);
+            }
+        }
+        // a queue wait with a timeout, 0 waits forever
+        else if (tcb[i].state == STATE_BLOCKED_QUEUE && tcb[i].ticks > 0)
+        {
+            tcb[i].ticks--;
+            if (tcb[i].ticks == 0)
+            {
+                queueTimeout(i);
             }
         }
     }
 
+    // time slicing, wakes above already pended a switch if one is needed
     if (preemption)
     {
         triggerPendSvFault();
     }
+    exitCritical(basepri);
 }
 
 // REQUIRED: in coop and preemptive, modify this function to add support for task switching
@@ -508,15 +2520,170 @@ void pendSvIsr(void)
 //    uint32_t debugFlags = PRINT_MFAULT_FLAGS;
 //    printFaultDebug(debugFlags);
 
-    taskCurrent = rtosScheduler();
-    applySramAccessMask(tcb[taskCurrent].srd);
+    // systick preempts pendsv and charges cycles too
+    uint32_t basepri = enterCritical();
+    chargeCpuCycles();
+    uint8_t taskPrevious = taskCurrent;
+
+    // while the scheduler is locked a ready task keeps the cpu unless it
+    // yielded, the switch is retried by the final schedUnlock
+    // the depth is read from the task's own block, a killed task has none
+    if (tcb[taskCurrent].state == STATE_READY && !yieldRequested
+            && tcb[taskCurrent].priv->schedDepth > 0)
+    {
+        tcb[taskCurrent].priv->schedPending = true;
+    }
+    else
+    {
+        taskCurrent = rtosScheduler();
+        if (taskCurrent != taskPrevious)
+        {
+            shared.taskCurrent = taskCurrent;
+            shared.priv = tcb[taskCurrent].priv;
+        }
+        traceRecord(TRACE_SWITCH, taskCurrent, taskPrevious);
+        recordWakeLatency(taskCurrent);
+    }
+    yieldRequested = false;
+    exitCritical(basepri);
+    applyTaskAccess();
+
+    // thread mode privilege is not part of the stacked context
+    if (tcb[taskCurrent].privileged)
+    {
+        clearTMPL();
+    }
+    else
+    {
+        setTMPL();
+    }
     restoreContext(tcb[taskCurrent].sp);
 
 }
 
-void triggerPendSvFault()
+void triggerPendSvFault()
+{
+    NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;
+}
+
+// Copy data from internal TCB to the caller's provided pointer
+void fillTaskInfo(uint8_t index, TaskInfo *info)
+{
+    info->pid = tcb[index].pid;
+    strncpy(info->name, tcb[index].name, 16);
+    info->state = tcb[index].state;
+    info->priority = tcb[index].priority;
+    info->currentPriority = tcb[index].currentPriority;
+    info->ticks = tcb[index].ticks;
+
+    // usage is 0-10000 (hundredths of a percent)
+    foldCpuUsage(index);
+    info->cycles = tcb[index].cycles;
+    info->usage = tcb[index].usage;
+    info->usage10s = tcb[index].load10s >> LOAD_FSHIFT;
+    info->usage60s = tcb[index].load60s >> LOAD_FSHIFT;
+}
+
+void fillMutexInfo(uint8_t index, MutexInfo *info)
+{
+    int i;
+    info->ref = poolHandle(&mutexPool, index);
+    info->lock = mutexes[index].lock;
+    info->recursive = mutexes[index].recursive;
+    info->recursion = mutexDepth(index);
+    info->lockedBy = mutexes[index].lockedBy;
+    info->queueSize = mutexes[index].queueSize;
+    for (i = 0; i < info->queueSize; i++)
+    {
+        info->processQueue[i] = mutexes[index].processQueue[i];
+    }
+    info->stats = mutexes[index].stats;
+}
+
+void fillSemaphoreInfo(uint8_t index, SemaphoreInfo *info)
+{
+    int i;
+    info->ref = poolHandle(&semaphorePool, index);
+    info->count = semaphores[index].count;
+    info->queueSize = semaphores[index].queueSize;
+    for (i = 0; i < info->queueSize; i++)
+    {
+        info->processQueue[i] = semaphores[index].processQueue[i];
+    }
+    info->stats = semaphores[index].stats;
+}
+
+void fillRwLockInfo(uint8_t index, RwLockInfo *info)
+{
+    int i;
+    info->ref = poolHandle(&rwlockPool, index);
+    info->writeLocked = rwlocks[index].writeLocked;
+    info->writer = rwlocks[index].writer;
+    info->readerCount = rwlocks[index].readerCount;
+    info->writersWaiting = rwlocks[index].writersWaiting;
+    info->queueSize = rwlocks[index].queueSize;
+    for (i = 0; i < info->queueSize; i++)
+    {
+        info->processQueue[i] = rwlocks[index].processQueue[i];
+    }
+    info->stats = rwlocks[index].stats;
+}
+
+void fillShmInfo(uint8_t index, ShmInfo *info)
+{
+    info->ref = poolHandle(&shmPool, index);
+    strcpy(info->name, shms[index].name);
+    info->base = shms[index].base;
+    info->size = shms[index].size;
+    info->owner = shms[index].owner;
+    info->readers = shms[index].readers;
+    info->writers = shms[index].writers;
+}
+
+void fillTopicInfo(uint8_t index, TopicInfo *info)
+{
+    int i;
+    info->ref = poolHandle(&topicPool, index);
+    info->sampleSize = topics[index].sampleSize;
+    info->sequence = topics[index].sequence;
+    info->subscriberCount = topics[index].subscriberCount;
+    for (i = 0; i < info->subscriberCount; i++)
+    {
+        info->subscribers[i] = topics[index].subscribers[i];
+        info->pending[i] = topics[index].sequence - topics[index].cursors[i];
+    }
+}
+
+void fillStreamInfo(uint8_t index, StreamInfo *info)
+{
+    info->ref = poolHandle(&streamPool, index);
+    info->count = streams[index].count;
+    info->trigger = streams[index].trigger;
+    info->reader = streams[index].reader;
+    info->writers = streams[index].writers;
+}
+
+void fillQueueInfo(uint8_t index, QueueInfo *info)
+{
+    info->ref = poolHandle(&queuePool, index);
+    info->messageSize = queues[index].messageSize;
+    info->count = queues[index].count;
+    info->urgent = queues[index].count ?
+            queues[index].priority[queues[index].slots[0]] : 0;
+    info->senders = queues[index].senders;
+    info->receivers = queues[index].receivers;
+}
+
+void fillConditionInfo(uint8_t index, ConditionInfo *info)
 {
-    NVIC_INT_CTRL_R |= NVIC_INT_CTRL_PEND_SV;
+    int i;
+    info->ref = poolHandle(&conditionPool, index);
+    info->mutex = conditions[index].mutex;
+    info->queueSize = conditions[index].queueSize;
+    for (i = 0; i < info->queueSize; i++)
+    {
+        info->processQueue[i] = conditions[index].processQueue[i];
+    }
 }
 
 // REQUIRED: modify this function to add support for the service call
@@ -529,118 +2696,92 @@ void svCallIsr(void)
     pc = pc - 2;
     uint8_t svcCallNum = *pc;
 
+    // kernel isrs that post or notify can run at a higher priority than svc,
+    // so the whole call runs as one critical section
+    uint32_t basepri = enterCritical();
+    tcb[taskCurrent].svcFrame = psp;
+    traceRecord(TRACE_SVC, taskCurrent, svcCallNum);
+
     switch (svcCallNum)
     {
     case 0:
+        yieldRequested = true;
         triggerPendSvFault();
         break;
     case 1:
-        tcb[taskCurrent].state = STATE_DELAYED;
-        tcb[taskCurrent].ticks = psp[0];
-        triggerPendSvFault();
+        sleepKernel(psp[0]);
         break;
     case 2:
-        if (mutexes[psp[0]].lock)
+    {
+        int16_t m = poolLookup(&mutexPool, psp[0]);
+        psp[0] = false;
+        if (m < 0)
         {
-            mutexes[psp[0]].processQueue[mutexes[psp[0]].queueSize] =
-                    taskCurrent;
-            mutexes[psp[0]].queueSize++;
-            tcb[taskCurrent].state = STATE_BLOCKED_MUTEX;
-            tcb[taskCurrent].mutex = psp[0];
-
-            if (priorityInheritance)
+            break;
+        }
+        if (mutexes[m].lock && mutexes[m].lockedBy == taskCurrent)
+        {
+            // re-entry by the owner never queues behind itself, the count
+            // lives in the owner's private block and must not wrap
+            if (mutexes[m].recursive
+                    && tcb[taskCurrent].priv->mutexDepth[m] < MAX_MUTEX_DEPTH)
             {
-                uint8_t owner = mutexes[psp[0]].lockedBy;
-                // If the blocked task (current) is more important than the owner
-                if (tcb[taskCurrent].currentPriority
-                        < tcb[owner].currentPriority)
-                {
-                    // Promote the owner to the higher priority
-                    tcb[owner].currentPriority =
-                            tcb[taskCurrent].currentPriority;
-                }
+                tcb[taskCurrent].priv->mutexDepth[m]++;
+                psp[0] = true;
             }
-
+        }
+        else if (mutexes[m].lock)
+        {
+            // true stays in r0 for when the mutex is handed over
+            psp[0] = true;
+            mutexEnqueue(m, taskCurrent);
             triggerPendSvFault();
         }
         else
         {
-            mutexes[psp[0]].lockedBy = taskCurrent;
-            mutexes[psp[0]].lock = true;
-            tcb[taskCurrent].mutex = psp[0];
+            psp[0] = true;
+            mutexAcquire(m, taskCurrent);
         }
+    }
         break;
     case 3:
-        if (mutexes[psp[0]].lockedBy == taskCurrent) // Only owner can unlock
+    {
+        int16_t m = poolLookup(&mutexPool, psp[0]);
+        // Only owner can unlock
+        if (m >= 0 && mutexes[m].lock && mutexes[m].lockedBy == taskCurrent)
         {
-            if (priorityInheritance)
-            {
-                // Restore the task to its original base priority
-                tcb[taskCurrent].currentPriority = tcb[taskCurrent].priority;
-            }
-
-            if (mutexes[psp[0]].queueSize > 0)
+            if (mutexDepth(m) > 0)
             {
-                uint8_t newMutexOwner = mutexes[psp[0]].processQueue[0];
-                tcb[newMutexOwner].state = STATE_READY;
-                mutexes[psp[0]].lockedBy = newMutexOwner;
-
-                int i = 0;
-                for (i = 0; i < mutexes[psp[0]].queueSize - 1; i++)
-                {
-                    mutexes[psp[0]].processQueue[i] =
-                            mutexes[psp[0]].processQueue[i + 1];
-                }
-
-                mutexes[psp[0]].queueSize--;
+                tcb[taskCurrent].priv->mutexDepth[m]--;
             }
             else
             {
-                // No one waiting: just unlock
-                mutexes[psp[0]].lock = false;
-                mutexes[psp[0]].lockedBy = 0;
+                mutexRelease(m);
             }
-            // Update the current task's record to show it holds nothing
-            tcb[taskCurrent].mutex = 0;
         }
+    }
         break;
     case 4:
-        if (semaphores[psp[0]].count == 0)
-        {
-            semaphores[psp[0]].processQueue[semaphores[psp[0]].queueSize] =
-                    taskCurrent;
-            semaphores[psp[0]].queueSize++;
-            tcb[taskCurrent].state = STATE_BLOCKED_SEMAPHORE;
-            tcb[taskCurrent].semaphore = psp[0];
-            triggerPendSvFault();
-        }
-        else
+    {
+        int16_t s = poolLookup(&semaphorePool, psp[0]);
+        // true stays in r0 when a blocked wait is woken by a post
+        psp[0] = (s >= 0);
+        if (s < 0)
         {
-            semaphores[psp[0]].count--;
+            break;
         }
+        waitKernel(s);
+    }
         break;
     case 5:
-        if (semaphores[psp[0]].queueSize > 0)
-        {
-            uint8_t waitingTask = semaphores[psp[0]].processQueue[0];
-            tcb[waitingTask].state = STATE_READY;
-            if (tcb[waitingTask].priority < tcb[taskCurrent].priority)
-            {
-                triggerPendSvFault();
-            }
-
-            int i = 0;
-            for (i = 0; i < semaphores[psp[0]].queueSize - 1; i++)
-            {
-                semaphores[psp[0]].processQueue[i] =
-                        semaphores[psp[0]].processQueue[i + 1];
-            }
-            semaphores[psp[0]].queueSize--;
-        }
-        else
+    {
+        int16_t s = poolLookup(&semaphorePool, psp[0]);
+        psp[0] = (s >= 0);
+        if (s >= 0)
         {
-            semaphores[psp[0]].count++;
+            postKernel(s);
         }
+    }
         break;
     case 6:
     {
@@ -657,7 +2798,11 @@ void svCallIsr(void)
             int i;
             for (i = 0; i < MAX_TASKS; i++)
             {
-                if (tcb[i].pid == (void*) input)
+                // killThread passes the task fn, destroyThread the pid
+                // several tasks may share fn, take the first still alive
+                if (tcb[i].state != STATE_INVALID
+                        && tcb[i].state != STATE_KILLED
+                        && (tcb[i].pid == input || (uint32_t) tcb[i].fn == input))
                 {
                     taskToKill = i;
                     break;
@@ -686,75 +2831,66 @@ void svCallIsr(void)
         }
         else
         {
-            // Copy data from internal TCB to the Shell's provided pointer
-            info->pid = (uint32_t) tcb[index].pid;
-            strncpy(info->name, tcb[index].name, 16);
-            info->state = tcb[index].state;
-            info->priority = tcb[index].priority;
-            info->currentPriority = tcb[index].currentPriority;
-            info->time = tcb[index].time;
-            info->ticks = tcb[index].ticks;
-
-            /*
-             // Calculate total time (optional helper logic)
-             uint32_t total = 0;
-             int k;
-             for (k = 0; k < MAX_TASKS; k++)
-             total += tcb[k].time;
-             info->totalTime = total;
-             */
-
-            info->time = tcb[index].usage;
-            info->totalTime = 10000;
-
+            fillTaskInfo(index, info);
             psp[0] = 1; // Return true
         }
     }
         break;
     case 8:
     {
-        // Type 0: Mutex
-        // Type 1: Semaphore
-        int i;
-        uint8_t type = (uint8_t) psp[0];
-        uint8_t index = (uint8_t) psp[1];
-
-        if (type == 0) // Mutex
+        // the handle carries the object type
+        int16_t m = poolLookup(&mutexPool, psp[0]);
+        int16_t s = poolLookup(&semaphorePool, psp[0]);
+        int16_t r = poolLookup(&rwlockPool, psp[0]);
+        int16_t c = poolLookup(&conditionPool, psp[0]);
+        int16_t h = poolLookup(&shmPool, psp[0]);
+        int16_t t = poolLookup(&topicPool, psp[0]);
+        int16_t b = poolLookup(&streamPool, psp[0]);
+        int16_t q = poolLookup(&queuePool, psp[0]);
+
+        if (m >= 0)
         {
-            MutexInfo *info = (MutexInfo*) psp[2];
-            if (index < MAX_MUTEXES)
-            {
-                info->lock = mutexes[index].lock;
-                info->lockedBy = mutexes[index].lockedBy;
-                info->queueSize = mutexes[index].queueSize;
-                for (i = 0; i < info->queueSize; i++)
-                {
-                    info->processQueue[i] = mutexes[index].processQueue[i];
-                }
-                psp[0] = 1; // Success
-            }
-            else
-            {
-                psp[0] = 0; // Fail
-            }
+            fillMutexInfo(m, (MutexInfo*) psp[1]);
+            psp[0] = 1; // Success
         }
-        else // Semaphore
+        else if (s >= 0)
         {
-            SemaphoreInfo *info = (SemaphoreInfo*) psp[2];
-            if (index < MAX_SEMAPHORES)
-            {
-                info->count = semaphores[index].count;
-                info->queueSize = semaphores[index].queueSize;
-                for (i = 0; i < info->queueSize; i++)
-                {
-                    info->processQueue[i] = semaphores[index].processQueue[i];
-                }
-                psp[0] = 1; // Success
-            }
-            else
-            {
-                psp[0] = 0; // Fail
-            }
+            fillSemaphoreInfo(s, (SemaphoreInfo*) psp[1]);
+            psp[0] = 1; // Success
+        }
+        else if (r >= 0)
+        {
+            fillRwLockInfo(r, (RwLockInfo*) psp[1]);
+            psp[0] = 1; // Success
+        }
+        else if (c >= 0)
+        {
+            fillConditionInfo(c, (ConditionInfo*) psp[1]);
+            psp[0] = 1; // Success
+        }
+        else if (h >= 0)
+        {
+            fillShmInfo(h, (ShmInfo*) psp[1]);
+            psp[0] = 1; // Success
+        }
+        else if (t >= 0)
+        {
+            fillTopicInfo(t, (TopicInfo*) psp[1]);
+            psp[0] = 1; // Success
+        }
+        else if (b >= 0)
+        {
+            fillStreamInfo(b, (StreamInfo*) psp[1]);
+            psp[0] = 1; // Success
+        }
+        else if (q >= 0)
+        {
+            fillQueueInfo(q, (QueueInfo*) psp[1]);
+            psp[0] = 1; // Success
+        }
+        else
+        {
+            psp[0] = 0; // Fail
         }
     }
         break;
@@ -789,7 +2925,7 @@ void svCallIsr(void)
         {
             if (strcmp(tcb[i].name, name) == 0)
             {
-                restartThreadKernel((_fn) tcb[i].pid); // Call the internal helper
+                restartTaskKernel(i); // Call the internal helper
                 break;
             }
         }
@@ -813,16 +2949,12 @@ void svCallIsr(void)
         for (i = 0; i < MAX_TASKS; i++)
         {
             // find matching function pointer
-            if (tcb[i].pid == fn && tcb[i].state != STATE_INVALID)
+            if (tcb[i].fn == fn && tcb[i].state != STATE_INVALID)
             {
                 tcb[i].priority = prio;
 
-                // if PI isn't boosting task, update current prio
-                // lowers prio
-                if (tcb[i].currentPriority > prio)
-                {
-                    tcb[i].currentPriority = prio;
-                }
+                // keeps any boost still lent by lock waiters or clients
+                inheritPriority(i);
                 break;
             }
         }
@@ -831,8 +2963,416 @@ void svCallIsr(void)
     case 15:
         priorityScheduler = (bool) psp[0];
         break;
+    case 16:
+    {
+        uint32_t previous = getTraceMaskKernel();
+        setTraceMaskKernel(psp[0]);
+        psp[0] = previous;
+    }
+        break;
+    case 17:
+        psp[0] = readTraceKernel(psp[0], (TraceRecord*) psp[1], psp[2]);
+        break;
+    case 18:
+        clearTraceKernel();
+        break;
+    case 19:
+    {
+        LockStats empty = { 0 };
+        int i;
+        for (i = 0; i < mutexPool.count; i++)
+        {
+            mutexes[mutexOrder[i]].stats = empty;
+        }
+        for (i = 0; i < semaphorePool.count; i++)
+        {
+            semaphores[semaphoreOrder[i]].stats = empty;
+        }
+        for (i = 0; i < rwlockPool.count; i++)
+        {
+            rwlocks[rwlockOrder[i]].stats = empty;
+        }
+    }
+        break;
+    case 20:
+    {
+        // whole system in one trap so the figures are consistent
+        SystemSnapshot *snapshot = (SystemSnapshot*) psp[0];
+        int i;
+
+        snapshot->cycleCount = DWT_CYCCNT_R;
+        snapshot->taskCount = taskCount;
+        snapshot->taskCurrent = taskCurrent;
+        for (i = 0; i < MAX_TASKS; i++)
+        {
+            if (tcb[i].state == STATE_INVALID)
+            {
+                snapshot->tasks[i].state = STATE_INVALID;
+            }
+            else
+            {
+                fillTaskInfo(i, &snapshot->tasks[i]);
+            }
+        }
+        snapshot->mutexCount = mutexPool.count;
+        for (i = 0; i < mutexPool.count; i++)
+        {
+            fillMutexInfo(mutexOrder[i], &snapshot->mutexes[i]);
+        }
+        snapshot->semaphoreCount = semaphorePool.count;
+        for (i = 0; i < semaphorePool.count; i++)
+        {
+            fillSemaphoreInfo(semaphoreOrder[i], &snapshot->semaphores[i]);
+        }
+        snapshot->rwlockCount = rwlockPool.count;
+        for (i = 0; i < rwlockPool.count; i++)
+        {
+            fillRwLockInfo(rwlockOrder[i], &snapshot->rwlocks[i]);
+        }
+        snapshot->conditionCount = conditionPool.count;
+        for (i = 0; i < conditionPool.count; i++)
+        {
+            fillConditionInfo(conditionOrder[i], &snapshot->conditions[i]);
+        }
+        snapshot->shmCount = shmPool.count;
+        for (i = 0; i < shmPool.count; i++)
+        {
+            fillShmInfo(shmOrder[i], &snapshot->shms[i]);
+        }
+        snapshot->topicCount = topicPool.count;
+        for (i = 0; i < topicPool.count; i++)
+        {
+            fillTopicInfo(topicOrder[i], &snapshot->topics[i]);
+        }
+        snapshot->streamCount = streamPool.count;
+        for (i = 0; i < streamPool.count; i++)
+        {
+            fillStreamInfo(streamOrder[i], &snapshot->streams[i]);
+        }
+        snapshot->queueCount = queuePool.count;
+        for (i = 0; i < queuePool.count; i++)
+        {
+            fillQueueInfo(queueOrder[i], &snapshot->queues[i]);
+        }
+    }
+        break;
+    case 21:
+        setProfilingKernel((bool) psp[0], (uint8_t) psp[1]);
+        break;
+    case 22:
+        getProfileInfoKernel((ProfileInfo*) psp[0]);
+        break;
+    case 23:
+        psp[0] = readProfileKernel(psp[0], (uint16_t*) psp[1], psp[2]);
+        break;
+    case 24:
+    {
+        uint8_t index = (uint8_t) psp[0];
+        if (index >= MAX_TASKS || tcb[index].state == STATE_INVALID)
+        {
+            psp[0] = 0;
+        }
+        else
+        {
+            *(LatencyInfo*) psp[1] = tcb[index].latency;
+            psp[0] = 1;
+        }
+    }
+        break;
+    case 25:
+    {
+        LatencyInfo empty = { 0 };
+        int i;
+        for (i = 0; i < MAX_TASKS; i++)
+        {
+            tcb[i].latency = empty;
+        }
+    }
+        break;
+    case 26:
+        psp[0] = notifyKernel((uint8_t) psp[0], psp[1], (uint8_t) psp[2]);
+        break;
+    case 27:
+        // returns the value, then clears the requested bits
+        if (tcb[taskCurrent].notifyPending)
+        {
+            uint32_t clear = psp[0];
+            psp[0] = tcb[taskCurrent].notifyValue;
+            tcb[taskCurrent].notifyValue &= ~clear;
+            tcb[taskCurrent].notifyPending = false;
+        }
+        else
+        {
+            tcb[taskCurrent].notifyClear = psp[0];
+            tcb[taskCurrent].state = STATE_BLOCKED_NOTIFY;
+            triggerPendSvFault();
+        }
+        break;
+    case 28:
+        psp[0] = createMutexKernel((uint8_t) psp[0]);
+        break;
+    case 29:
+        psp[0] = createSemaphoreKernel((uint8_t) psp[0]);
+        break;
+    case 30:
+        psp[0] = deleteMutexKernel(psp[0]);
+        break;
+    case 31:
+        psp[0] = deleteSemaphoreKernel(psp[0]);
+        break;
+    case 32:
+        psp[0] = createRwLockKernel();
+        break;
+    case 33:
+        psp[0] = deleteRwLockKernel(psp[0]);
+        break;
+    case 34:
+    {
+        int16_t r = poolLookup(&rwlockPool, psp[0]);
+        if (r < 0)
+        {
+            break;
+        }
+        rwlock *rw = &rwlocks[r];
+        // a holder of either kind already has read access
+        if ((rw->readers & (1 << taskCurrent))
+                || (rw->writeLocked && rw->writer == taskCurrent))
+        {
+            break;
+        }
+        if (rw->writeLocked || rw->writersWaiting > 0)
+        {
+            rwBlock(r, false);
+        }
+        else
+        {
+            rw->readers |= 1 << taskCurrent;
+            rw->readerCount++;
+            rw->stats.acquisitions++;
+        }
+    }
+        break;
+    case 35:
+    {
+        int16_t r = poolLookup(&rwlockPool, psp[0]);
+        if (r < 0)
+        {
+            break;
+        }
+        rwlock *rw = &rwlocks[r];
+        if (rw->writeLocked && rw->writer == taskCurrent)
+        {
+            break;
+        }
+        if (rw->writeLocked || rw->readerCount > 0)
+        {
+            rwBlock(r, true);
+        }
+        else
+        {
+            rw->writeLocked = true;
+            rw->writer = taskCurrent;
+            rw->lockedAt = DWT_CYCCNT_R;
+            rw->stats.acquisitions++;
+        }
+    }
+        break;
+    case 36:
+    {
+        int16_t r = poolLookup(&rwlockPool, psp[0]);
+        if (r >= 0)
+        {
+            rwRelease(r, taskCurrent, TRACE_WAKE_RWLOCK);
+        }
+    }
+        break;
+    case 37:
+        psp[0] = createConditionKernel(psp[0]);
+        break;
+    case 38:
+        psp[0] = deleteConditionKernel(psp[0]);
+        break;
+    case 39:
+    {
+        int16_t c = poolLookup(&conditionPool, psp[0]);
+        int16_t m = (c >= 0) ? poolLookup(&mutexPool, conditions[c].mutex) : -1;
+        // the caller must hold the bound mutex exactly once
+        if (m < 0 || !mutexes[m].lock || mutexes[m].lockedBy != taskCurrent
+                || mutexDepth(m) > 0)
+        {
+            psp[0] = false;
+            break;
+        }
+        // release and block in one call so no signal can be missed between
+        mutexRelease(m);
+        conditions[c].processQueue[conditions[c].queueSize] = taskCurrent;
+        conditions[c].queueSize++;
+        tcb[taskCurrent].state = STATE_BLOCKED_CONDITION;
+        tcb[taskCurrent].blockedAt = DWT_CYCCNT_R;
+        psp[0] = true;
+        triggerPendSvFault();
+    }
+        break;
+    case 40:
+    {
+        int16_t c = poolLookup(&conditionPool, psp[0]);
+        if (c >= 0)
+        {
+            conditionWake(c);
+        }
+    }
+        break;
+    case 41:
+    {
+        int16_t c = poolLookup(&conditionPool, psp[0]);
+        if (c >= 0)
+        {
+            while (conditionWake(c))
+            {
+            }
+        }
+    }
+        break;
+    case 42:
+    {
+        // both halves in one trap, the poster cannot miss the reply
+        int16_t post = poolLookup(&semaphorePool, psp[0]);
+        int16_t wait = poolLookup(&semaphorePool, psp[1]);
+        psp[0] = (post >= 0 && wait >= 0);
+        if (psp[0])
+        {
+            postKernel(post);
+            waitKernel(wait);
+        }
+    }
+        break;
+    case 43:
+    {
+        int16_t m = poolLookup(&mutexPool, psp[0]);
+        psp[0] = (m >= 0 && mutexes[m].lock && mutexes[m].lockedBy == taskCurrent
+                && mutexDepth(m) == 0);
+        if (psp[0])
+        {
+            mutexRelease(m);
+            sleepKernel(psp[1]);
+        }
+    }
+        break;
+    case 44:
+    {
+        int16_t s = poolLookup(&semaphorePool, psp[0]);
+        if (s >= 0)
+        {
+            postKernel(s);
+        }
+        yieldRequested = true;
+        triggerPendSvFault();
+    }
+        break;
+    // waitAny
+    case 45:
+        psp[0] = waitAnyKernel((const handle*) psp[0], psp[1]);
+        break;
+    // msgSend
+    case 46:
+        psp[0] = sendKernel(psp[0], (void*) psp[1], psp[2], psp[3]);
+        break;
+    // msgReceive
+    case 47:
+        psp[0] = receiveKernel((void*) psp[0], (uint8_t*) psp[1]);
+        break;
+    // msgReply
+    case 48:
+        psp[0] = replyKernel(psp[0], (const void*) psp[1], psp[2]);
+        break;
+    // bufferAlloc
+    case 49:
+        psp[0] = (uint32_t) bufferAllocKernel(psp[0]);
+        break;
+    // bufferTransfer
+    case 50:
+        psp[0] = bufferTransferKernel((void*) psp[0], psp[1]);
+        break;
+    // bufferFree
+    case 51:
+        psp[0] = bufferFreeKernel((void*) psp[0]);
+        break;
+    // shmCreate
+    case 52:
+        psp[0] = shmCreateKernel((const char*) psp[0], psp[1]);
+        break;
+    // shmDelete
+    case 53:
+        psp[0] = shmDeleteKernel(psp[0]);
+        break;
+    // shmGrant
+    case 54:
+        psp[0] = shmGrantKernel(psp[0], psp[1], psp[2]);
+        break;
+    // shmOpen
+    case 55:
+    {
+        int16_t r = findShm((const char*) psp[0]);
+        psp[0] = (r < 0) ? INVALID_HANDLE : poolHandle(&shmPool, r);
+    }
+        break;
+    // shmBase
+    case 56:
+        psp[0] = (uint32_t) shmBaseKernel(psp[0]);
+        break;
+    case 57:
+        psp[0] = createTopicKernel(psp[0]);
+        break;
+    case 58:
+        psp[0] = deleteTopicKernel(psp[0]);
+        break;
+    // subscribe
+    case 59:
+        psp[0] = subscribeKernel(psp[0]);
+        break;
+    // unsubscribe
+    case 60:
+        psp[0] = unsubscribeKernel(psp[0]);
+        break;
+    // publish
+    case 61:
+        psp[0] = publishKernel(psp[0], (const void*) psp[1]);
+        break;
+    // topicRead
+    case 62:
+        psp[0] = topicReadKernel(psp[0], (void*) psp[1], psp[2]);
+        break;
+    case 63:
+        psp[0] = createStreamKernel(psp[0]);
+        break;
+    case 64:
+        psp[0] = deleteStreamKernel(psp[0]);
+        break;
+    // streamWrite
+    case 65:
+        psp[0] = streamWriteKernel(psp[0], (const uint8_t*) psp[1], psp[2]);
+        break;
+    // streamRead
+    case 66:
+        psp[0] = streamReadKernel(psp[0], (uint8_t*) psp[1], psp[2], psp[3]);
+        break;
+    case 67:
+        psp[0] = createQueueKernel(psp[0]);
+        break;
+    case 68:
+        psp[0] = deleteQueueKernel(psp[0]);
+        break;
+    // queueSend
+    case 69:
+        psp[0] = queueSendKernel(psp[0], (const void*) psp[1], psp[2], psp[3]);
+        break;
+    // queueReceive
+    case 70:
+        psp[0] = queueReceiveKernel(psp[0], (void*) psp[1], (uint8_t*) psp[2],
+                                    psp[3]);
+        break;
     }
-
+    exitCritical(basepri);
 }
 
 bool populateTaskInfo(uint8_t index, TaskInfo *info)
@@ -840,9 +3380,8 @@ bool populateTaskInfo(uint8_t index, TaskInfo *info)
     __asm(" SVC #7 ");
 }
 
-// Type 0: Mutex
-// Type 1: Semaphore
-bool getResourceInfo(uint8_t type, uint8_t index, void *info)
+// info is the Info struct that matches the handle type
+bool getResourceInfo(handle object, void *info)
 {
     __asm(" SVC #8 ");
 }
@@ -872,23 +3411,426 @@ void setSched(bool prio_on)
     __asm(" SVC #15 ");
 }
 
+// returns the previous mask
+uint32_t setTraceMask(uint32_t mask)
+{
+    __asm(" SVC #16 ");
+}
+
+uint32_t readTrace(uint32_t first, TraceRecord records[], uint32_t count)
+{
+    __asm(" SVC #17 ");
+}
+
+void clearTrace(void)
+{
+    __asm(" SVC #18 ");
+}
+
+void resetLockStats(void)
+{
+    __asm(" SVC #19 ");
+}
+
+void getSnapshot(SystemSnapshot *snapshot)
+{
+    __asm(" SVC #20 ");
+}
+
+// turning profiling on clears the histogram
+void setProfiling(bool on, uint8_t shift)
+{
+    __asm(" SVC #21 ");
+}
+
+void getProfileInfo(ProfileInfo *info)
+{
+    __asm(" SVC #22 ");
+}
+
+uint32_t readProfile(uint32_t first, uint16_t counts[], uint32_t count)
+{
+    __asm(" SVC #23 ");
+}
+
+bool getLatencyInfo(uint8_t index, LatencyInfo *info)
+{
+    __asm(" SVC #24 ");
+}
+
+void resetLatency(void)
+{
+    __asm(" SVC #25 ");
+}
+
+// signals a task directly without a kernel object
+bool notify(uint8_t task, uint32_t value, uint8_t action)
+{
+    __asm(" SVC #26 ");
+}
+
+//-----------------------------------------------------------------------------
+// ISR-safe services
+//-----------------------------------------------------------------------------
+
+// Handler mode cannot use SVC, so these update kernel state directly inside
+// a critical section. A wake that needs a switch pends PendSV, which runs
+// when the isr returns. Only isrs at PRIORITY_KERNEL_MAX or lower may call
+// these.
+
+bool notifyFromIsr(uint8_t task, uint32_t value, uint8_t action)
+{
+    uint32_t basepri = enterCritical();
+    bool ok = notifyKernel(task, value, action);
+    exitCritical(basepri);
+    return ok;
+}
+
+// never blocks, returns the bytes that fit
+uint8_t streamWriteFromIsr(handle stream, const void *data, uint8_t size)
+{
+    uint32_t basepri = enterCritical();
+    int16_t st = poolLookup(&streamPool, stream);
+    uint8_t n = 0;
+    if (st >= 0)
+    {
+        n = streamPut(st, data, size);
+        streamWakeReader(st);
+    }
+    exitCritical(basepri);
+    return n;
+}
+bool postFromIsr(handle semaphore)
+{
+    uint32_t basepri = enterCritical();
+    int16_t s = poolLookup(&semaphorePool, semaphore);
+    if (s >= 0)
+    {
+        postKernel(s);
+    }
+    exitCritical(basepri);
+    return s >= 0;
+}
+
+// blocks until notified, returns the value before clearBitsOnExit is applied
+uint32_t notifyTake(uint32_t clearBitsOnExit)
+{
+    __asm(" SVC #27 ");
+}
+
+//-----------------------------------------------------------------------------
+// Object pools
+//-----------------------------------------------------------------------------
+
+// returns INVALID_HANDLE when the pool is full
+// options is 0 or MUTEX_RECURSIVE
+handle createMutex(uint8_t options)
+{
+    __asm(" SVC #28 ");
+}
+
+handle createSemaphore(uint8_t count)
+{
+    __asm(" SVC #29 ");
+}
+
+// fails if the object is stale, held or has waiters
+bool deleteMutex(handle mutex)
+{
+    __asm(" SVC #30 ");
+}
+
+bool deleteSemaphore(handle semaphore)
+{
+    __asm(" SVC #31 ");
+}
+
+handle createRwLock(void)
+{
+    __asm(" SVC #32 ");
+}
+
+bool deleteRwLock(handle rw)
+{
+    __asm(" SVC #33 ");
+}
+
+// shared access, blocks while a writer holds or waits for the lock
+void readLock(handle rw)
+{
+    __asm(" SVC #34 ");
+}
+
+// exclusive access, blocks until every reader has left
+void writeLock(handle rw)
+{
+    __asm(" SVC #35 ");
+}
+
+// releases the read or write lock held by the caller
+void rwUnlock(handle rw)
+{
+    __asm(" SVC #36 ");
+}
+
+// binds the condition to a mutex for its whole life
+handle createCondition(handle mutex)
+{
+    __asm(" SVC #37 ");
+}
+
+bool deleteCondition(handle cv)
+{
+    __asm(" SVC #38 ");
+}
+
+// releases the bound mutex and blocks, returns holding the mutex again
+// returns false at once if the caller does not hold the mutex
+bool condWait(handle cv)
+{
+    __asm(" SVC #39 ");
+}
+
+// moves the longest waiter to the mutex
+void condSignal(handle cv)
+{
+    __asm(" SVC #40 ");
+}
+
+// moves every waiter to the mutex
+void condBroadcast(handle cv)
+{
+    __asm(" SVC #41 ");
+}
+
+//-----------------------------------------------------------------------------
+// Compound services
+//-----------------------------------------------------------------------------
+
+// Each does two operations in one svc with one scheduling decision, so the
+// pair costs a single trap and nothing can run between the two halves.
+
+// posts one semaphore and waits on another
+// returns false without doing either if a handle is invalid
+bool postAndWait(handle postSemaphore, handle waitSemaphore)
+{
+    __asm(" SVC #42 ");
+}
+
+// releases a mutex held once and sleeps
+// returns false without doing either if the caller does not hold it
+bool unlockAndSleep(handle mutex, uint32_t tick)
+{
+    __asm(" SVC #43 ");
+}
+
+// posts a semaphore and yields
+void postAndYield(handle semaphore)
+{
+    __asm(" SVC #44 ");
+}
+
+// blocks until one of the semaphores (or NOTIFY_SOURCE) is ready and returns
+// its index; a semaphore is taken, a notification is left for notifyTake
+// returns -1 for a bad or repeated handle
+int8_t waitAny(const handle sources[], uint8_t count)
+{
+    __asm(" SVC #45 ");
+}
+
+// sends size bytes of buffer to a server task and blocks until it replies;
+// the reply (at most replySize bytes) overwrites buffer and its length is
+// returned, or -1 if the server is invalid or dies
+int16_t msgSend(uint8_t server, void *buffer, uint8_t size, uint8_t replySize)
+{
+    __asm(" SVC #46 ");
+}
+
+// blocks until a client sends; *length holds the capacity of buffer and is
+// set to the request length, the client to reply to is returned
+int8_t msgReceive(void *buffer, uint8_t *length)
+{
+    __asm(" SVC #47 ");
+}
+
+// releases a client blocked in msgSend with size bytes of reply
+bool msgReply(uint8_t client, const void *reply, uint8_t size)
+{
+    __asm(" SVC #48 ");
+}
+
+// allocates a heap buffer only the caller can access, or NULL
+void* bufferAlloc(uint32_t size)
+{
+    __asm(" SVC #49 ");
+}
+
+// gives a buffer the caller owns to task without copying it
+bool bufferTransfer(void *base, uint8_t task)
+{
+    __asm(" SVC #50 ");
+}
+
+bool bufferFree(void *base)
+{
+    __asm(" SVC #51 ");
+}
+
+// creates a named heap region the caller can read and write
+handle shmCreate(const char name[], uint32_t size)
+{
+    __asm(" SVC #52 ");
+}
+
+bool shmDelete(handle region)
+{
+    __asm(" SVC #53 ");
+}
+
+// sets the access of task to a region the caller created, SHM_NONE revokes
+// it; read only grants of one task must all sit in the same 8 KiB of sram
+bool shmGrant(handle region, uint8_t task, uint8_t access)
+{
+    __asm(" SVC #54 ");
+}
+
+handle shmOpen(const char name[])
+{
+    __asm(" SVC #55 ");
+}
+
+// returns the region's address if the caller was granted access, else NULL
+void* shmBase(handle region)
+{
+    __asm(" SVC #56 ");
+}
+
+// sampleSize is fixed for the topic, at most MAX_TOPIC_SAMPLE bytes
+handle createTopic(uint8_t sampleSize)
+{
+    __asm(" SVC #57 ");
+}
+
+// fails while a subscriber is blocked reading it
+bool deleteTopic(handle topic)
+{
+    __asm(" SVC #58 ");
+}
+
+bool subscribe(handle topic)
+{
+    __asm(" SVC #59 ");
+}
+
+bool unsubscribe(handle topic)
+{
+    __asm(" SVC #60 ");
+}
+
+// copies one sample into the topic, whatever the number of subscribers
+bool publish(handle topic, const void *sample)
+{
+    __asm(" SVC #61 ");
+}
+
+int8_t topicReadSvc(handle topic, void *sample, uint8_t mode)
+{
+    __asm(" SVC #62 ");
+}
+
+// mode is TOPIC_NEXT or TOPIC_LATEST, optionally with TOPIC_NOWAIT
+// a blocked read is woken without data and reads it from the ring itself
+int8_t topicRead(handle topic, void *sample, uint8_t mode)
+{
+    int8_t result;
+    do
+    {
+        result = topicReadSvc(topic, sample, mode);
+    }
+    while (result == TOPIC_RETRY);
+    return result;
+}
+
+// trigger is the number of bytes a blocked read waits for
+handle createStream(uint8_t trigger)
+{
+    __asm(" SVC #63 ");
+}
+
+// fails while a reader or writer is blocked on it
+bool deleteStream(handle stream)
+{
+    __asm(" SVC #64 ");
+}
+
+// blocks while the ring is full until every byte is written
+uint8_t streamWrite(handle stream, const void *data, uint8_t size)
+{
+    __asm(" SVC #65 ");
+}
+
+// returns up to size bytes, blocking until the trigger level (or size, if
+// smaller) is buffered unless block is false
+uint8_t streamRead(handle stream, void *buffer, uint8_t size, bool block)
+{
+    __asm(" SVC #66 ");
+}
+
+// every message of the queue is messageSize bytes
+handle createQueue(uint8_t messageSize)
+{
+    __asm(" SVC #67 ");
+}
+
+// fails while a sender or receiver is blocked on it
+bool deleteQueue(handle queue)
+{
+    __asm(" SVC #68 ");
+}
+
+// priority 0 is received first; waits up to timeout ms for space, false if
+// the queue stayed full
+bool queueSend(handle queue, const void *message, uint8_t priority,
+               uint32_t timeout)
+{
+    __asm(" SVC #69 ");
+}
+
+// takes the most urgent message, oldest first among equals; priority may be
+// NULL, false if none arrived within timeout ms
+bool queueReceive(handle queue, void *message, uint8_t *priority,
+                  uint32_t timeout)
+{
+    __asm(" SVC #70 ");
+}
+
 uint8_t getTaskCurrent()
 {
     return taskCurrent;
 }
 
+// kernel side, for handlers that report on the task they interrupted
+uint32_t getTaskPid(uint8_t task)
+{
+    return tcb[task].pid;
+}
+
 void forceKillThread(int taskIndex)
 {
+    // a killed task has already released everything, including its stack
     if (taskIndex
-            < 0|| taskIndex >= MAX_TASKS || tcb[taskIndex].state == STATE_INVALID)
+            < 0|| taskIndex >= MAX_TASKS || tcb[taskIndex].state == STATE_INVALID
+            || tcb[taskIndex].state == STATE_KILLED)
     {
         return;
     }
-    // release mutexes held by task
+    // release mutexes held by task, only live objects are visited
+    int l;
     int m;
-    for (m = 0; m < MAX_MUTEXES; m++)
+    for (l = 0; l < mutexPool.count; l++)
     {
-        if (mutexes[m].lockedBy == taskIndex)
+        m = mutexOrder[l];
+        if (mutexes[m].lock && mutexes[m].lockedBy == taskIndex)
         {
             mutexes[m].lockedBy = 0;
             mutexes[m].lock = false;
@@ -899,7 +3841,10 @@ void forceKillThread(int taskIndex)
                 uint8_t nextTask = mutexes[m].processQueue[0];
                 mutexes[m].lockedBy = nextTask;
                 mutexes[m].lock = true;
-                tcb[nextTask].state = STATE_READY;
+                mutexes[m].lockedAt = DWT_CYCCNT_R;
+                wakeTask(nextTask, TRACE_WAKE_KILL);
+                recordLockWait(&mutexes[m].stats, nextTask,
+                               mutexes[m].lockedAt);
 
                 // Shift queue
                 int q;
@@ -909,6 +3854,11 @@ void forceKillThread(int taskIndex)
                 }
                 mutexes[m].queueSize--;
             }
+            publishMutexOwner(m, taskIndex);
+            if (mutexes[m].lock)
+            {
+                inheritPriority(mutexes[m].lockedBy);
+            }
         }
 
         // Remove task from any Mutex waiting queues
@@ -931,8 +3881,9 @@ void forceKillThread(int taskIndex)
 
     // post semaphores held by task
     int s;
-    for (s = 0; s < MAX_SEMAPHORES; s++)
+    for (l = 0; l < semaphorePool.count; l++)
     {
+        s = semaphoreOrder[l];
         int q;
         for (q = 0; q < semaphores[s].queueSize; q++)
         {
@@ -951,6 +3902,116 @@ void forceKillThread(int taskIndex)
         }
     }
 
+    // leave rw lock queues, then drop any read or write hold
+    int r;
+    for (l = 0; l < rwlockPool.count; l++)
+    {
+        r = rwlockOrder[l];
+        int q;
+        for (q = 0; q < rwlocks[r].queueSize; q++)
+        {
+            if (rwlocks[r].processQueue[q] == taskIndex)
+            {
+                rwDequeue(&rwlocks[r], q);
+                break;
+            }
+        }
+        if (!rwRelease(r, taskIndex, TRACE_WAKE_KILL))
+        {
+            // a writer leaving the queue may let queued readers in
+            rwGrant(r, TRACE_WAKE_KILL);
+        }
+    }
+
+    // leave condition queues
+    int c;
+    for (l = 0; l < conditionPool.count; l++)
+    {
+        c = conditionOrder[l];
+        int q;
+        for (q = 0; q < conditions[c].queueSize; q++)
+        {
+            if (conditions[c].processQueue[q] == taskIndex)
+            {
+                int k;
+                for (k = q; k < conditions[c].queueSize - 1; k++)
+                {
+                    conditions[c].processQueue[k] = conditions[c].processQueue[k + 1];
+                }
+                conditions[c].queueSize--;
+                break;
+            }
+        }
+    }
+
+    // leave a server, or fail the sends of its own clients
+    if (tcb[taskIndex].state == STATE_BLOCKED_SEND
+            || tcb[taskIndex].state == STATE_BLOCKED_REPLY)
+    {
+        uint8_t server = tcb[taskIndex].msgServer;
+        tcb[server].msgSenders &= ~(1 << taskIndex);
+        tcb[taskIndex].state = STATE_KILLED;
+        inheritPriority(server);
+    }
+    int t;
+    for (t = 0; t < MAX_TASKS; t++)
+    {
+        if ((tcb[t].state == STATE_BLOCKED_SEND
+                || tcb[t].state == STATE_BLOCKED_REPLY)
+                && tcb[t].msgServer == taskIndex)
+        {
+            wakeTask(t, TRACE_WAKE_KILL);
+        }
+    }
+    tcb[taskIndex].msgSenders = 0;
+
+    // free buffers the task owned at the time
+    int b;
+    for (b = 0; b < MAX_BUFFERS; b++)
+    {
+        if (buffers[b].base != NULL && buffers[b].owner == taskIndex)
+        {
+            bufferRelease(b);
+        }
+    }
+
+    // free the regions it created and drop its grants to the others
+    for (l = 0; l < shmPool.count; l++)
+    {
+        if (shms[shmOrder[l]].owner == taskIndex)
+        {
+            shmRelease(shmOrder[l]);
+            l--;
+        }
+        else
+        {
+            shmSetAccess(shmOrder[l], taskIndex, SHM_NONE);
+        }
+    }
+
+    // unsubscribe from every topic
+    for (l = 0; l < topicPool.count; l++)
+    {
+        topicRemove(topicOrder[l], taskIndex);
+    }
+
+    // drop a blocked stream read or write
+    for (l = 0; l < streamPool.count; l++)
+    {
+        if (streams[streamOrder[l]].reader == taskIndex)
+        {
+            streams[streamOrder[l]].reader = MAX_TASKS;
+        }
+        streams[streamOrder[l]].writers &= ~(1 << taskIndex);
+    }
+
+    // drop a blocked queue send or receive
+    for (l = 0; l < queuePool.count; l++)
+    {
+        queues[queueOrder[l]].senders &= ~(1 << taskIndex);
+        queues[queueOrder[l]].receivers &= ~(1 << taskIndex);
+    }
+
     // free memory
     if (tcb[taskIndex].stackBase != NULL)
     {
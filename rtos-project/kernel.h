@@ -18,28 +18,107 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "shell.h"
+#include "trace.h"
+#include "profile.h"
+#include "pool.h"
 
 //-----------------------------------------------------------------------------
 // RTOS Defines and Kernel Variables
 //-----------------------------------------------------------------------------
 
+// DWT cycle counter (not defined in tm4c123gh6pm.h)
+#define DWT_CTRL_R              (*((volatile uint32_t *)0xE0001000))
+#define DWT_CYCCNT_R            (*((volatile uint32_t *)0xE0001004))
+#define DWT_CTRL_CYCCNTENA      0x00000001  // Enable cycle counter
+#define NVIC_DBG_INT_TRCENA     0x01000000  // Enable DWT and ITM (DEMCR)
+
+// exception priorities, 0 is highest and only the top 3 bits are implemented
+// isrs at PRIORITY_ZERO_LATENCY are never masked by the kernel, so they must
+// not call any kernel service; isrs from PRIORITY_KERNEL_MAX down may use the
+// FromIsr services
+#define PRIORITY_FAULT          0 // mpu, bus and usage faults
+#define PRIORITY_ZERO_LATENCY   1
+#define PRIORITY_KERNEL_MAX     2 // basepri threshold of a critical section
+#define PRIORITY_GPIO           4
+#define PRIORITY_UART           5
+#define PRIORITY_SVC            6
+#define PRIORITY_SYSTICK        6 // same as svc so the two never nest
+#define PRIORITY_PENDSV         7 // lowest, switches only after all isrs finish
+#define PRIORITY_TO_BASEPRI(p)  ((uint32_t)(p) << 5)
+
 // function pointer
 typedef void (*_fn)();
 
-// mutex
-#define MAX_MUTEXES 1
-#define MAX_MUTEX_QUEUE_SIZE 2
-#define resource 0
+// mutex pool
+#define MAX_MUTEXES 8
+#define MAX_MUTEX_QUEUE_SIZE MAX_TASKS // a broadcast can queue every waiter
+#define MUTEX_RECURSIVE 1 // createMutex option, the owner may lock again
+
+// semaphore pool
+#define MAX_SEMAPHORES 12
+#define MAX_SEMAPHORE_QUEUE_SIZE MAX_TASKS // multi-waiters sit on several queues
+
+// waitAny
+#define MAX_WAIT_SOURCES 4
+#define NOTIFY_SOURCE    ((handle) 0xFF000000) // the caller's own notification
+
+// send/receive/reply
+#define MAX_MESSAGE_SIZE 64 // bytes copied per send or reply
+
+// heap buffers passed between tasks without copying
+#define MAX_BUFFERS 8
+
+// shared memory regions
+#define MAX_SHMS 4
+#define SHM_NAME_SIZE 12
+#define SHM_NONE  0                // revokes a grant
+#define SHM_READ  1
+#define SHM_WRITE 2                // read and write
 
-// semaphore
-#define MAX_SEMAPHORES 3
-#define MAX_SEMAPHORE_QUEUE_SIZE 2
-#define keyPressed 0
-#define keyReleased 1
-#define flashReq 2
+// publish/subscribe topics
+#define MAX_TOPICS 4
+#define MAX_TOPIC_SUBSCRIBERS 4
+#define MAX_TOPIC_SAMPLE 16        // bytes per sample
+#define TOPIC_HISTORY 4            // samples kept for lagging subscribers
+#define TOPIC_NEXT   0             // oldest sample the subscriber has not read
+#define TOPIC_LATEST 1             // newest sample, older ones are skipped
+#define TOPIC_NOWAIT 2             // return 0 instead of blocking
+
+// stream buffers
+#define MAX_STREAMS 2
+#define STREAM_SIZE 64             // bytes in each ring
+
+// priority message queues
+#define MAX_QUEUES 2
+#define QUEUE_LENGTH 8             // messages in each queue
+#define QUEUE_MESSAGE_SIZE 8       // largest message in bytes
+#define QUEUE_NOWAIT  0            // timeouts are in ms
+#define QUEUE_FOREVER 0xFFFFFFFF
+
+// reader-writer lock pool
+#define MAX_RWLOCKS 4
+#define MAX_RWLOCK_QUEUE_SIZE MAX_TASKS
+
+// condition variable pool
+#define MAX_CONDITIONS 4
+#define MAX_CONDITION_QUEUE_SIZE MAX_TASKS
+
+// handles of the objects main creates at boot, the table sits in the shared
+// kernel window, which tasks can read but not write
+#define IPC_HANDLES 9
+extern handle * const ipcHandles;
+#define resource     (ipcHandles[0])
+#define keyPressed   (ipcHandles[1])
+#define keyReleased  (ipcHandles[2])
+#define flashReq     (ipcHandles[3])
+#define keyInterrupt (ipcHandles[4])
+#define benchStart   (ipcHandles[5])
+#define uartRx       (ipcHandles[6])
+#define jobQueue     (ipcHandles[7])
+#define benchCheck   (ipcHandles[8])
 
 // tasks
-#define MAX_TASKS 12
+#define MAX_TASKS 16
 
 // task states
 #define STATE_INVALID           0 // no task
@@ -49,13 +128,43 @@ typedef void (*_fn)();
 #define STATE_BLOCKED_SEMAPHORE 4 // has run, but now blocked by semaphore
 #define STATE_BLOCKED_MUTEX     5 // has run, but now blocked by mutex
 #define STATE_KILLED            6 // task has been killed
+#define STATE_BLOCKED_NOTIFY    7 // has run, but now awaiting a notification
+#define STATE_BLOCKED_RWLOCK    8 // has run, but now blocked by a rw lock
+#define STATE_BLOCKED_CONDITION 9 // has run, but now awaiting a condition
+#define STATE_BLOCKED_ANY       10 // has run, but now awaiting one of several sources
+#define STATE_BLOCKED_SEND      11 // has run, but now awaiting a server to receive
+#define STATE_BLOCKED_REPLY     12 // has run, but now awaiting a server to reply
+#define STATE_BLOCKED_RECEIVE   13 // has run, but now awaiting a client to send
+#define STATE_BLOCKED_TOPIC     14 // has run, but now awaiting a published sample
+#define STATE_BLOCKED_STREAM    15 // has run, but now awaiting stream data or space
+#define STATE_BLOCKED_QUEUE     16 // has run, but now awaiting a message or space
+
+// notification actions
+#define NOTIFY_GIVE      0 // value += 1
+#define NOTIFY_SET_BITS  1 // value |= arg
+#define NOTIFY_INCREMENT 2 // value += arg
+#define NOTIFY_OVERWRITE 3 // value = arg
+#define NOTIFY_CLEAR_ALL 0xFFFFFFFF
+
+// contention statistics, times are in cpu cycles
+typedef struct _lock_stats
+{
+    uint32_t acquisitions;         // successful locks / waits
+    uint32_t contentions;          // acquisitions that had to block
+    uint64_t totalWait;            // total time spent blocked
+    uint32_t maxWait;              // longest time spent blocked
+    uint32_t maxHold;              // longest time held (mutexes only)
+} LockStats;
 
 typedef struct _mutex
 {
     bool lock;
+    bool recursive;
     uint8_t queueSize;
     uint8_t processQueue[MAX_MUTEX_QUEUE_SIZE];
     uint8_t lockedBy;
+    uint32_t lockedAt;             // cycle count when last acquired
+    LockStats stats;
 } mutex;
 
 typedef struct _semaphore
@@ -63,8 +172,83 @@ typedef struct _semaphore
     uint8_t count;
     uint8_t queueSize;
     uint8_t processQueue[MAX_SEMAPHORE_QUEUE_SIZE];
+    LockStats stats;
 } semaphore;
 
+// task sets are bitmasks, so MAX_TASKS must stay at or below 16
+typedef struct _rwlock
+{
+    bool writeLocked;
+    uint8_t writer;                // owner while writeLocked
+    uint8_t readerCount;
+    uint16_t readers;              // tasks holding a read lock
+    uint8_t writersWaiting;
+    uint16_t wantsWrite;           // queued tasks waiting to write
+    uint8_t queueSize;
+    uint8_t processQueue[MAX_RWLOCK_QUEUE_SIZE];
+    uint32_t lockedAt;             // cycle count when last write locked
+    LockStats stats;
+} rwlock;
+
+// waiters are moved to the bound mutex when signalled
+typedef struct _condition
+{
+    handle mutex;                  // mutex a waiter must hold
+    uint8_t queueSize;
+    uint8_t processQueue[MAX_CONDITION_QUEUE_SIZE];
+} condition;
+
+// heap shared by several tasks, each with its own access
+typedef struct _shm_region
+{
+    char name[SHM_NAME_SIZE];
+    void *base;
+    uint32_t size;
+    uint8_t owner;                 // creator, the only task that may grant
+    uint16_t readers;              // tasks with read only access
+    uint16_t writers;              // tasks with read and write access
+} shmRegion;
+
+// samples live once in the topic ring, each subscriber only keeps the
+// sequence number of the next sample it will read
+typedef struct _topic
+{
+    uint8_t sampleSize;
+    uint32_t sequence;             // samples published so far
+    uint8_t samples[TOPIC_HISTORY][MAX_TOPIC_SAMPLE];
+    uint8_t subscriberCount;
+    uint8_t subscribers[MAX_TOPIC_SUBSCRIBERS];
+    uint32_t cursors[MAX_TOPIC_SUBSCRIBERS];
+    uint16_t waiting;              // subscribers blocked for the next sample
+} topic;
+
+// byte ring with a single reader, which is woken once the trigger level is
+// buffered rather than on every byte
+typedef struct _stream
+{
+    uint8_t data[STREAM_SIZE];
+    uint8_t head;                  // next byte to read
+    uint8_t count;
+    uint8_t trigger;               // bytes a blocked read waits for
+    uint8_t reader;                // blocked reader, MAX_TASKS if none
+    uint16_t writers;              // writers blocked while the ring is full
+} stream;
+
+// slots[0..count-1] is a binary heap of the queued messages, most urgent
+// (lowest priority value, then oldest) first; the rest are free slots
+typedef struct _msg_queue
+{
+    uint8_t messageSize;
+    uint8_t count;
+    uint8_t slots[QUEUE_LENGTH];
+    uint8_t priority[QUEUE_LENGTH];          // per slot, 0 is most urgent
+    uint16_t order[QUEUE_LENGTH];            // per slot, breaks priority ties
+    uint8_t data[QUEUE_LENGTH][QUEUE_MESSAGE_SIZE];
+    uint16_t sequence;                       // next order to hand out
+    uint16_t senders;                        // tasks blocked while full
+    uint16_t receivers;                      // tasks blocked while empty
+} msgQueue;
+
 typedef struct _task_info
 {
     uint32_t pid;
@@ -72,55 +256,228 @@ typedef struct _task_info
     uint8_t state;
     uint8_t priority;
     uint32_t currentPriority;
-    uint32_t time;
-    uint32_t totalTime;
     uint32_t ticks;
+    uint64_t cycles;     // total cpu cycles consumed
+    uint32_t usage;      // cpu usage over the last 1 s (0-10000)
+    uint32_t usage10s;   // 10 s moving average (0-10000)
+    uint32_t usage60s;   // 60 s moving average (0-10000)
 } TaskInfo;
 
 typedef struct _mutex_info
 {
+    handle ref;
     bool lock;
+    bool recursive;
+    uint8_t recursion;             // locks beyond the first
     uint8_t lockedBy;
     uint8_t queueSize;
     uint8_t processQueue[MAX_MUTEX_QUEUE_SIZE];
+    LockStats stats;
 } MutexInfo;
 
+typedef struct _rwlock_info
+{
+    handle ref;
+    bool writeLocked;
+    uint8_t writer;
+    uint8_t readerCount;
+    uint8_t writersWaiting;
+    uint8_t queueSize;
+    uint8_t processQueue[MAX_RWLOCK_QUEUE_SIZE];
+    LockStats stats;
+} RwLockInfo;
+
+typedef struct _condition_info
+{
+    handle ref;
+    handle mutex;
+    uint8_t queueSize;
+    uint8_t processQueue[MAX_CONDITION_QUEUE_SIZE];
+} ConditionInfo;
+
+typedef struct _shm_info
+{
+    handle ref;
+    char name[SHM_NAME_SIZE];
+    void *base;
+    uint32_t size;
+    uint8_t owner;
+    uint16_t readers;
+    uint16_t writers;
+} ShmInfo;
+
+typedef struct _topic_info
+{
+    handle ref;
+    uint8_t sampleSize;
+    uint32_t sequence;
+    uint8_t subscriberCount;
+    uint8_t subscribers[MAX_TOPIC_SUBSCRIBERS];
+    uint32_t pending[MAX_TOPIC_SUBSCRIBERS]; // samples not yet read
+} TopicInfo;
+
+typedef struct _stream_info
+{
+    handle ref;
+    uint8_t count;
+    uint8_t trigger;
+    uint8_t reader;
+    uint16_t writers;
+} StreamInfo;
+
+typedef struct _queue_info
+{
+    handle ref;
+    uint8_t messageSize;
+    uint8_t count;
+    uint8_t urgent;                // priority of the next message
+    uint16_t senders;
+    uint16_t receivers;
+} QueueInfo;
+
 typedef struct _sem_info
 {
+    handle ref;
     uint8_t count;
     uint8_t queueSize;
     uint8_t processQueue[MAX_SEMAPHORE_QUEUE_SIZE];
+    LockStats stats;
 } SemaphoreInfo;
 
+// wake-to-run latency, bucket k > 0 counts latencies below
+// 2^(k + LATENCY_MIN_SHIFT) cycles, the last bucket counts everything above
+#define LATENCY_BUCKETS   16
+#define LATENCY_MIN_SHIFT 6
+
+typedef struct _latency_info
+{
+    uint32_t count;                // dispatches after a wake
+    uint32_t max;                  // worst latency in cycles
+    uint16_t buckets[LATENCY_BUCKETS];
+} LatencyInfo;
+
+typedef struct _system_snapshot
+{
+    uint32_t cycleCount;           // DWT_CYCCNT when taken
+    uint8_t taskCount;
+    uint8_t taskCurrent;
+    TaskInfo tasks[MAX_TASKS];     // invalid slots only have state set
+    uint8_t mutexCount;            // live objects only, packed
+    uint8_t semaphoreCount;
+    uint8_t rwlockCount;
+    uint8_t conditionCount;
+    uint8_t shmCount;
+    uint8_t topicCount;
+    uint8_t streamCount;
+    uint8_t queueCount;
+    MutexInfo mutexes[MAX_MUTEXES];
+    SemaphoreInfo semaphores[MAX_SEMAPHORES];
+    RwLockInfo rwlocks[MAX_RWLOCKS];
+    ConditionInfo conditions[MAX_CONDITIONS];
+    ShmInfo shms[MAX_SHMS];
+    TopicInfo topics[MAX_TOPICS];
+    StreamInfo streams[MAX_STREAMS];
+    QueueInfo queues[MAX_QUEUES];
+} SystemSnapshot;
+
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
 
-bool initMutex(uint8_t mutex);
-bool initSemaphore(uint8_t semaphore, uint8_t count);
+handle createMutexKernel(uint8_t options);
+handle createSemaphoreKernel(uint8_t count);
+bool deleteMutexKernel(handle mutex);
+bool deleteSemaphoreKernel(handle semaphore);
+handle createMutex(uint8_t options);
+handle createSemaphore(uint8_t count);
+bool deleteMutex(handle mutex);
+bool deleteSemaphore(handle semaphore);
+handle createRwLockKernel(void);
+bool deleteRwLockKernel(handle rw);
+handle createRwLock(void);
+bool deleteRwLock(handle rw);
+handle createConditionKernel(handle mutex);
+bool deleteConditionKernel(handle cv);
+handle createCondition(handle mutex);
+bool deleteCondition(handle cv);
+handle createTopicKernel(uint8_t sampleSize);
+bool deleteTopicKernel(handle topic);
+handle createTopic(uint8_t sampleSize);
+bool deleteTopic(handle topic);
+bool subscribe(handle topic);
+bool unsubscribe(handle topic);
+bool publish(handle topic, const void *sample);
+int8_t topicRead(handle topic, void *sample, uint8_t mode);
+handle createStreamKernel(uint8_t trigger);
+bool deleteStreamKernel(handle stream);
+handle createStream(uint8_t trigger);
+bool deleteStream(handle stream);
+uint8_t streamWrite(handle stream, const void *data, uint8_t size);
+uint8_t streamWriteFromIsr(handle stream, const void *data, uint8_t size);
+uint8_t streamRead(handle stream, void *buffer, uint8_t size, bool block);
+handle createQueueKernel(uint8_t messageSize);
+bool deleteQueueKernel(handle queue);
+handle createQueue(uint8_t messageSize);
+bool deleteQueue(handle queue);
+bool queueSend(handle queue, const void *message, uint8_t priority,
+               uint32_t timeout);
+bool queueReceive(handle queue, void *message, uint8_t *priority,
+                  uint32_t timeout);
 
 void initRtos(void);
 void startRtos(void);
 
+uint32_t enterCritical(void);
+void exitCritical(uint32_t basepri);
+
 bool createThread(_fn fn, const char name[], uint8_t priority, uint32_t stackBytes);
+bool createThreadArg(_fn fn, void *arg, const char name[], uint8_t priority,
+                     uint32_t stackBytes);
+int8_t getTaskIndex(_fn fn);
+bool setThreadPrivileged(_fn fn, bool on);
 void killThread(_fn fn);
 void destroyThread(uint32_t pid);
 void restartThread(_fn fn);
 void restartThreadKernel(_fn fn);
+void restartTaskKernel(uint8_t taskIndex);
 void setThreadPriority(_fn fn, uint8_t priority);
 
 void yield(void);
+void schedLock(void);
+void schedUnlock(void);
 void sleep(uint32_t tick);
-void wait(int8_t semaphore);
-void post(int8_t semaphore);
-void lock(int8_t mutex);
-void unlock(int8_t mutex);
+bool wait(handle semaphore);
+bool post(handle semaphore);
+bool lock(handle mutex);
+void unlock(handle mutex);
+void readLock(handle rw);
+void writeLock(handle rw);
+void rwUnlock(handle rw);
+bool postAndWait(handle postSemaphore, handle waitSemaphore);
+bool unlockAndSleep(handle mutex, uint32_t tick);
+void postAndYield(handle semaphore);
+int8_t waitAny(const handle sources[], uint8_t count);
+int16_t msgSend(uint8_t server, void *buffer, uint8_t size, uint8_t replySize);
+int8_t msgReceive(void *buffer, uint8_t *length);
+bool msgReply(uint8_t client, const void *reply, uint8_t size);
+void* bufferAlloc(uint32_t size);
+bool bufferTransfer(void *base, uint8_t task);
+bool bufferFree(void *base);
+handle shmCreate(const char name[], uint32_t size);
+bool shmDelete(handle region);
+bool shmGrant(handle region, uint8_t task, uint8_t access);
+handle shmOpen(const char name[]);
+void* shmBase(handle region);
+bool condWait(handle cv);
+void condSignal(handle cv);
+void condBroadcast(handle cv);
 
 void testSRAMpriv();
 void testSRAMunpriv();
 void testSRAMunprivFree();
 
 void printPid(int newlines);
+void printTaskPid(uint32_t pid, int newlines);
 
 void systickIsr(void);
 void pendSvIsr(void);
@@ -128,13 +485,28 @@ void triggerPendSvFault(void);
 void svCallIsr(void);
 
 bool populateTaskInfo(uint8_t index, TaskInfo *info);
-bool getResourceInfo(uint8_t type, uint8_t index, void *info);
+bool getResourceInfo(handle object, void *info);
+void getSnapshot(SystemSnapshot *snapshot);
+bool getLatencyInfo(uint8_t index, LatencyInfo *info);
+void resetLatency(void);
+bool notify(uint8_t task, uint32_t value, uint8_t action);
+bool notifyFromIsr(uint8_t task, uint32_t value, uint8_t action);
+bool postFromIsr(handle semaphore);
+uint32_t notifyTake(uint32_t clearBitsOnExit);
 int32_t getPid(const char name[]);
 void launchTask(const char name[]);
 void setPreemption(bool on);
 void setPriorityInheritance(bool on);
 void setSched(bool prio_on);
+uint32_t setTraceMask(uint32_t mask);
+uint32_t readTrace(uint32_t first, TraceRecord records[], uint32_t count);
+void clearTrace(void);
+void resetLockStats(void);
+void setProfiling(bool on, uint8_t shift);
+void getProfileInfo(ProfileInfo *info);
+uint32_t readProfile(uint32_t first, uint16_t counts[], uint32_t count);
 uint8_t getTaskCurrent();
+uint32_t getTaskPid(uint8_t task);
 void forceKillThread(int taskIndex);
 
 #endif
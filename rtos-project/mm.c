@@ -21,13 +21,17 @@
 #include "tm4c123gh6pm.h"
 #include "mm.h"
 
-#define MPU_REGION_COUNT 28     // defines maximum number of regions in MPU
+#define MPU_REGION_COUNT 21     // defines maximum number of regions in MPU
 #define MPU_REGION_SIZE_B 1024  // defines size in bytes of an MPU region
 
 #define MPU_REGIONS_FLASH 1
 #define MPU_REGIONS_PERIPHERALS 2
 #define MPU_REGIONS_SRAM_START 3
 #define MPU_REGIONS_SRAM_REGIONS 4
+#define MPU_REGIONS_SHARED_KERNEL 7  // highest region wins over the srd bits
+#define MPU_REGIONS_SRAM_READ 0      // lowest, only used where the sram
+                                     // regions have the subregion disabled
+#define MPU_SRAM_REGION_SIZE_B 8192  // each sram region has 8 subregions
 
 uint64_t mask;
 
@@ -505,6 +509,101 @@ void revokeSramAccessWindow(uint64_t *srdBitMask, uint32_t *baseAdd,
     }
 }
 
+// read only access is a region below the sram regions, reached where their
+// subregion is disabled; it spans one sram region, so every read only window
+// of a mask must sit in the same 8 KiB
+// leaves the mask alone and returns false if the window would not fit
+bool addSramReadWindow(uint64_t *readBitMask, uint32_t *baseAdd,
+                       uint32_t size_in_bytes)
+{
+    uint64_t newMask = *readBitMask;
+    int regions = 0;
+    int i;
+
+    addSramAccessWindow(&newMask, baseAdd, size_in_bytes);
+    for (i = 0; i < MPU_REGIONS_SRAM_REGIONS; i++)
+    {
+        if (((~newMask >> 8 * i) & 0xFF) != 0)
+        {
+            regions++;
+        }
+    }
+    if (regions > 1)
+    {
+        return false;
+    }
+    *readBitMask = newMask;
+    return true;
+}
+
+void applySramReadMask(uint64_t readBitMask)
+{
+    int i = 0;
+    while (i < MPU_REGIONS_SRAM_REGIONS && ((~readBitMask >> 8 * i) & 0xFF) == 0)
+    {
+        i++;
+    }
+
+    __asm(" ISB");
+    NVIC_MPU_BASE_R &= ~NVIC_MPU_BASE_VALID;
+    NVIC_MPU_NUMBER_R &= ~NVIC_MPU_NUMBER_M;
+    NVIC_MPU_NUMBER_R |= (MPU_REGIONS_SRAM_READ << NVIC_MPU_NUMBER_S)
+            & NVIC_MPU_NUMBER_M;
+    NVIC_MPU_ATTR_R &= ~NVIC_MPU_ATTR_ENABLE;
+
+    if (i < MPU_REGIONS_SRAM_REGIONS)
+    {
+        NVIC_MPU_BASE_R &= ~NVIC_MPU_BASE_ADDR_M;
+        NVIC_MPU_BASE_R |= (0x20000000 + i * MPU_SRAM_REGION_SIZE_B)
+                & NVIC_MPU_BASE_ADDR_M;
+
+        // 8 KiB (SIZE 12), AP 0b010 (privileged RW, unprivileged RO), XN 1
+        NVIC_MPU_ATTR_R = ((12 << 1) & NVIC_MPU_ATTR_SIZE_M)
+                | ((0b010 << 24) & NVIC_MPU_ATTR_AP_M)
+                | ((((readBitMask >> 8 * i) & 0xFF) << 8) & NVIC_MPU_ATTR_SRD_M)
+                | NVIC_MPU_ATTR_CACHEABLE
+                | NVIC_MPU_ATTR_XN
+                | NVIC_MPU_ATTR_ENABLE;
+    }
+
+    __asm(" ISB");
+}
+
+// opens a window of kernel memory to every task (read only, no execute)
+// size is a power of 2 of at least 32, base must be aligned to it and the
+// object must fill the whole window
+// the window must sit in os memory, which no task is ever granted
+void allowSharedAccess(void *base, uint32_t size_in_bytes)
+{
+    const unsigned int region = MPU_REGIONS_SHARED_KERNEL;
+    uint32_t size = 0;
+
+    // size_in_bytes = 2^(SIZE+1)
+    while ((2UL << size) < size_in_bytes)
+    {
+        size++;
+    }
+
+    __asm(" ISB");
+    NVIC_MPU_BASE_R &= ~NVIC_MPU_BASE_VALID;
+    NVIC_MPU_NUMBER_R &= ~NVIC_MPU_NUMBER_M;
+    NVIC_MPU_NUMBER_R |= (region << NVIC_MPU_NUMBER_S) & NVIC_MPU_NUMBER_M;
+    NVIC_MPU_ATTR_R &= ~NVIC_MPU_ATTR_ENABLE;
+
+    NVIC_MPU_BASE_R &= ~NVIC_MPU_BASE_ADDR_M;
+    NVIC_MPU_BASE_R |= (uint32_t) base & NVIC_MPU_BASE_ADDR_M;
+
+    // TEX 0b000, S 0, C 1, B 0 (same as sram)
+    // AP 0b010 (privileged RW, unprivileged RO), XN 1
+    NVIC_MPU_ATTR_R = ((size << 1) & NVIC_MPU_ATTR_SIZE_M)
+            | ((0b010 << 24) & NVIC_MPU_ATTR_AP_M)
+            | NVIC_MPU_ATTR_CACHEABLE
+            | NVIC_MPU_ATTR_XN
+            | NVIC_MPU_ATTR_ENABLE;
+
+    __asm(" ISB");
+}
+
 // REQUIRED: add code to initialize the memory manager
 void initMemoryManager(void)
 {
@@ -27,6 +27,9 @@ uint64_t createNoSramAccessMask(void);
 void applySramAccessMask(uint64_t srdBitMask);
 void addSramAccessWindow(uint64_t *srdBitMask, uint32_t *baseAdd, uint32_t size_in_bytes);
 void revokeSramAccessWindow(uint64_t *srdBitMask, uint32_t *baseAdd, uint32_t size_in_bytes);
+bool addSramReadWindow(uint64_t *readBitMask, uint32_t *baseAdd, uint32_t size_in_bytes);
+void applySramReadMask(uint64_t readBitMask);
+void allowSharedAccess(void *base, uint32_t size_in_bytes);
 void initMemoryManager(void);
 void initMpu(void);
 
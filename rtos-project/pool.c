@@ -0,0 +1,98 @@
+// Nicholas Nhat Tran
+// 1002027150
+
+// Kernel object pools and handles
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pool.h"
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// the caller owns the arrays, each must hold size entries
+void initPool(pool *p, uint8_t type, uint8_t size, uint8_t order[],
+              uint8_t position[], uint16_t generation[])
+{
+    uint8_t i;
+    p->type = type;
+    p->size = size;
+    p->count = 0;
+    p->order = order;
+    p->position = position;
+    p->generation = generation;
+    for (i = 0; i < size; i++)
+    {
+        order[i] = i;
+        position[i] = i;
+        generation[i] = 0;
+    }
+}
+
+// takes the first free slot, returns -1 when the pool is full
+// called from handler mode or before the rtos starts
+int16_t poolAlloc(pool *p)
+{
+    uint8_t slot;
+    if (p->count >= p->size)
+    {
+        return -1;
+    }
+    slot = p->order[p->count];
+    p->count++;
+    p->generation[slot]++;
+    return slot;
+}
+
+// swaps the slot with the last live one so the live slots stay packed
+void poolFree(pool *p, uint8_t slot)
+{
+    uint8_t last;
+    uint8_t pos;
+    if (!poolLive(p, slot))
+    {
+        return;
+    }
+    p->count--;
+    pos = p->position[slot];
+    last = p->order[p->count];
+    p->order[pos] = last;
+    p->position[last] = pos;
+    p->order[p->count] = slot;
+    p->position[slot] = p->count;
+}
+
+// returns the slot a handle refers to, or -1 if it is stale or mistyped
+int16_t poolLookup(const pool *p, handle h)
+{
+    uint8_t slot = HANDLE_SLOT(h);
+    if (HANDLE_TYPE(h) != p->type || slot >= p->size || !poolLive(p, slot)
+            || HANDLE_GENERATION(h) != p->generation[slot])
+    {
+        return -1;
+    }
+    return slot;
+}
+
+handle poolHandle(const pool *p, uint8_t slot)
+{
+    return ((uint32_t) p->type << 24) | ((uint32_t) p->generation[slot] << 8)
+            | slot;
+}
+
+bool poolLive(const pool *p, uint8_t slot)
+{
+    return slot < p->size && p->position[slot] < p->count;
+}
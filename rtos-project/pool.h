@@ -0,0 +1,67 @@
+// Nicholas Nhat Tran
+// 1002027150
+
+// Kernel object pools and handles
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//-----------------------------------------------------------------------------
+// Pool Defines
+//-----------------------------------------------------------------------------
+
+// a handle is type << 24 | generation << 8 | slot
+// the generation changes every time a slot is reused, so a handle to a
+// deleted object is rejected instead of reaching its successor
+typedef uint32_t handle;
+
+#define INVALID_HANDLE       0
+#define HANDLE_TYPE(h)       ((uint8_t) ((h) >> 24))
+#define HANDLE_GENERATION(h) ((uint16_t) ((h) >> 8))
+#define HANDLE_SLOT(h)       ((uint8_t) (h))
+
+// object types, 0 is never used so no valid handle is 0
+#define OBJECT_MUTEX     1
+#define OBJECT_SEMAPHORE 2
+#define OBJECT_RWLOCK    3
+#define OBJECT_CONDITION 4
+#define OBJECT_SHM       5
+#define OBJECT_TOPIC     6
+#define OBJECT_STREAM    7
+#define OBJECT_QUEUE     8
+
+// live slots are packed at the front of order so they can be listed and a
+// free slot can be taken without scanning
+typedef struct _pool
+{
+    uint8_t type;
+    uint8_t size;
+    uint8_t count;                 // live slots are order[0..count-1]
+    uint8_t *order;                // live slots, then free slots
+    uint8_t *position;             // where each slot sits in order
+    uint16_t *generation;          // current generation of each slot
+} pool;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initPool(pool *p, uint8_t type, uint8_t size, uint8_t order[],
+              uint8_t position[], uint16_t generation[]);
+int16_t poolAlloc(pool *p);
+void poolFree(pool *p, uint8_t slot);
+int16_t poolLookup(const pool *p, handle h);
+handle poolHandle(const pool *p, uint8_t slot);
+bool poolLive(const pool *p, uint8_t slot);
+
+#endif
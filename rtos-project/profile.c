@@ -0,0 +1,110 @@
+// Nicholas Nhat Tran
+// 1002027150
+
+// Statistical PC-sampling profiler
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tm4c123gh6pm.h"
+#include "profile.h"
+
+//-----------------------------------------------------------------------------
+// Profiler Variables
+//-----------------------------------------------------------------------------
+
+uint16_t profileCounts[PROFILE_BUCKETS];
+uint8_t profileShift = PROFILE_SHIFT_DEFAULT;
+bool profileOn = false;
+uint32_t profileSamples = 0;
+uint32_t profileOverflow = 0;
+uint32_t profileKernel = 0;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// called from systickIsr with the interrupted task's stack frame
+// psp[6] is the stacked PC, but only if systick interrupted thread mode;
+// when it preempted pendsv or another isr the sample is kernel time
+void profileSample(uint32_t *psp)
+{
+    if (profileOn)
+    {
+        uint32_t bucket = psp[6] >> profileShift;
+        profileSamples++;
+        if (!(NVIC_INT_CTRL_R & NVIC_INT_CTRL_RET_BASE))
+        {
+            profileKernel++;
+        }
+        else if (bucket < PROFILE_BUCKETS && profileCounts[bucket] != 0xFFFF)
+        {
+            profileCounts[bucket]++;
+        }
+        else
+        {
+            profileOverflow++;
+        }
+    }
+}
+
+// turning the profiler on starts a fresh histogram
+void setProfilingKernel(bool on, uint8_t shift)
+{
+    int i;
+    if (on)
+    {
+        if (shift < PROFILE_SHIFT_MIN || shift > PROFILE_SHIFT_MAX)
+        {
+            shift = PROFILE_SHIFT_DEFAULT;
+        }
+        for (i = 0; i < PROFILE_BUCKETS; i++)
+        {
+            profileCounts[i] = 0;
+        }
+        profileShift = shift;
+        profileSamples = 0;
+        profileOverflow = 0;
+        profileKernel = 0;
+    }
+    profileOn = on;
+}
+
+void getProfileInfoKernel(ProfileInfo *info)
+{
+    info->on = profileOn;
+    info->shift = profileShift;
+    info->samples = profileSamples;
+    info->overflow = profileOverflow;
+    info->kernel = profileKernel;
+}
+
+// copies up to count buckets starting at bucket first
+// returns the number of buckets copied
+uint32_t readProfileKernel(uint32_t first, uint16_t counts[], uint32_t count)
+{
+    uint32_t i;
+    if (first >= PROFILE_BUCKETS)
+    {
+        return 0;
+    }
+    if (count > PROFILE_BUCKETS - first)
+    {
+        count = PROFILE_BUCKETS - first;
+    }
+    for (i = 0; i < count; i++)
+    {
+        counts[i] = profileCounts[first + i];
+    }
+    return count;
+}
@@ -0,0 +1,47 @@
+// Nicholas Nhat Tran
+// 1002027150
+
+// Statistical PC-sampling profiler
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+#ifndef PROFILE_H_
+#define PROFILE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//-----------------------------------------------------------------------------
+// Profiler Defines
+//-----------------------------------------------------------------------------
+
+// histogram covers flash from 0 to PROFILE_BUCKETS << shift
+#define PROFILE_BUCKETS       256
+#define PROFILE_SHIFT_DEFAULT 7   // 128 byte buckets, covers 32 KiB
+#define PROFILE_SHIFT_MIN     2
+#define PROFILE_SHIFT_MAX     10
+
+typedef struct _profile_info
+{
+    bool on;
+    uint8_t shift;      // log2 of bucket size in bytes
+    uint32_t samples;   // total samples taken
+    uint32_t overflow;  // samples outside the histogram or saturated
+    uint32_t kernel;    // samples that interrupted another handler
+} ProfileInfo;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void profileSample(uint32_t *psp);
+void setProfilingKernel(bool on, uint8_t shift);
+void getProfileInfoKernel(ProfileInfo *info);
+uint32_t readProfileKernel(uint32_t first, uint16_t counts[], uint32_t count);
+
+#endif
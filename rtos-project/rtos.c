@@ -39,6 +39,8 @@
 #include "faults.h"
 #include "tasks.h"
 #include "shell.h"
+#include "workqueue.h"
+#include "bench.h"
 
 //-----------------------------------------------------------------------------
 // Main
@@ -59,14 +61,25 @@ int main(void)
     // Setup UART0 baud rate
     setUart0BaudRate(115200, 40e6);
 
-    // Initialize mutexes and semaphores
-    initMutex(resource);
-    initSemaphore(keyPressed, 1);
-    initSemaphore(keyReleased, 0);
-    initSemaphore(flashReq, 5);
+    // Create mutexes and semaphores
+    resource = createMutexKernel(0);
+    ok = (resource != INVALID_HANDLE);
+    keyPressed = createSemaphoreKernel(1);
+    ok &= (keyPressed != INVALID_HANDLE);
+    keyReleased = createSemaphoreKernel(0);
+    ok &= (keyReleased != INVALID_HANDLE);
+    flashReq = createSemaphoreKernel(5);
+    ok &= (flashReq != INVALID_HANDLE);
+    keyInterrupt = createSemaphoreKernel(0);
+    ok &= (keyInterrupt != INVALID_HANDLE);
+
+    // shell input arrives through a stream filled by the uart rx isr
+    uartRx = createStreamKernel(1);
+    ok &= (uartRx != INVALID_HANDLE);
+    enableUart0RxInterrupt();
 
     // Add required idle process at lowest priority
-    ok =  createThread(idle, "Idle", 7, 512);
+    ok &= createThread(idle, "Idle", 7, 512);
 
     // Add other processes
 
@@ -78,7 +91,10 @@ int main(void)
     ok &= createThread(important, "Important", 0, 1024);
     ok &= createThread(uncooperative, "Uncoop", 6, 1024);
     ok &= createThread(errant, "Errant", 6, 1024);
-    ok &= createThread(shell, "Shell", 6, 4096);
+    ok &= createThread(shell, "Shell", 6, 2048);
+    ok &= initWorkQueue();
+    ok &= initWorkerPool();
+    ok &= initBench();
 
 
 //    ok &= createThread(testPiHigh,   "High",   2, 1024); // High Priority
@@ -31,9 +31,6 @@
 //-----------------------------------------------------------------------------
 
 extern bool preemption;
-TaskInfo taskInfo[MAX_TASKS];
-MutexInfo mutexInfo[MAX_MUTEXES];
-SemaphoreInfo semaphoreInfo[MAX_SEMAPHORES];
 
 // REQUIRED: Add header files here for your strings functions, ...
 
@@ -48,173 +45,368 @@ void reboot(void)
     putsUart0("REBOOTING\n");
 }
 
-void ps(void)
+// prints a 0-10000 usage value as a percentage, padded to width
+void printUsage(uint32_t usage, int width)
 {
-    TaskInfo info;
+    char buffer[12];
+    int k;
+    int length;
+
+    itoa(usage / 100, buffer);
+    putsUart0(buffer);
+    length = strlen(buffer) + 3;
+    putsUart0(".");
+    if ((usage % 100) < 10)
+    {
+        putsUart0("0"); // Leading zero for decimal
+    }
+    itoa(usage % 100, buffer);
+    putsUart0(buffer);
+
+    for (k = 0; k < (width - length); k++)
+        putsUart0(" ");
+}
+
+void ps(SystemSnapshot *snapshot)
+{
+    TaskInfo *info;
     int i;
     int k;
     char buffer[16];
 
     putsUart0(
-            "PID     Name         State              Remaining Ticks   Priority   CPU %\n");
+            "PID     Name         State              Remaining Ticks   Priority   CPU 1s  CPU 10s CPU 60s\n");
     putsUart0(
-            "---     -----------  ----------------   ---------------   --------   -----\n");
+            "---     -----------  ----------------   ---------------   --------   ------  ------- -------\n");
+
+    getSnapshot(snapshot);
 
     for (i = 0; i < MAX_TASKS; i++)
     {
-        if (populateTaskInfo(i, &info))
+        info = &snapshot->tasks[i];
+        if (info->state != STATE_INVALID)
         {
-            if (info.state != STATE_INVALID)
-            {
-                // Print PID
-                itoa(info.pid, buffer);
-                putsUart0(buffer);
-
-                for (k = 0; k < (8 - strlen(buffer)); k++)
-                    putsUart0(" ");
-
-                // Print Name
-                putsUart0(info.name);
-                for (k = 0; k < (13 - strlen(info.name)); k++)
-                    putsUart0(" ");
+            // Print PID
+            itoa(info->pid, buffer);
+            putsUart0(buffer);
 
-                switch (info.state)
-                {
-                case STATE_UNRUN:
-                    putsUart0("1: ");
-                    putsUart0("UNRUN           ");
-                    break;
-                case STATE_READY:
-                    putsUart0("2: ");
-                    putsUart0("READY           ");
-                    break;
-                case STATE_DELAYED:
-                    putsUart0("3: ");
-                    putsUart0("DELAYED         ");
-                    break;
-                case STATE_BLOCKED_SEMAPHORE:
-                    putsUart0("4: ");
-                    putsUart0("BLOCKED (Sem)   ");
-                    break;
-                case STATE_BLOCKED_MUTEX:
-                    putsUart0("5: ");
-                    putsUart0("BLOCKED (Mut)   ");
-                    break;
-                case STATE_KILLED:
-                    putsUart0("6: ");
-                    putsUart0("KILLED          ");
-                    break;
-                default:
-                    putsUart0("UNKNOWN         ");
-                    break;
-                }
+            for (k = 0; k < (8 - strlen(buffer)); k++)
+                putsUart0(" ");
 
-                // Print remaining ticks
-                if (info.state == STATE_DELAYED)
-                {
-                    itoa(info.ticks, buffer);
-                    putsUart0(buffer);
+            // Print Name
+            putsUart0(info->name);
+            for (k = 0; k < (13 - strlen(info->name)); k++)
+                putsUart0(" ");
 
-                    // Calculate padding (Header is roughly 15 chars wide + 3 spacing)
-                    for (k = 0; k < (18 - strlen(buffer)); k++)
-                        putsUart0(" ");
-                }
-                else
-                {
-                    putsUart0("                  "); // 0 + 17 spaces
-                }
+            switch (info->state)
+            {
+            case STATE_UNRUN:
+                putsUart0("1: ");
+                putsUart0("UNRUN           ");
+                break;
+            case STATE_READY:
+                putsUart0("2: ");
+                putsUart0("READY           ");
+                break;
+            case STATE_DELAYED:
+                putsUart0("3: ");
+                putsUart0("DELAYED         ");
+                break;
+            case STATE_BLOCKED_SEMAPHORE:
+                putsUart0("4: ");
+                putsUart0("BLOCKED (Sem)   ");
+                break;
+            case STATE_BLOCKED_MUTEX:
+                putsUart0("5: ");
+                putsUart0("BLOCKED (Mut)   ");
+                break;
+            case STATE_KILLED:
+                putsUart0("6: ");
+                putsUart0("KILLED          ");
+                break;
+            case STATE_BLOCKED_NOTIFY:
+                putsUart0("7: ");
+                putsUart0("BLOCKED (Ntf)   ");
+                break;
+            case STATE_BLOCKED_RWLOCK:
+                putsUart0("8: ");
+                putsUart0("BLOCKED (RW)    ");
+                break;
+            case STATE_BLOCKED_CONDITION:
+                putsUart0("9: ");
+                putsUart0("BLOCKED (Cnd)   ");
+                break;
+            case STATE_BLOCKED_ANY:
+                putsUart0("10: ");
+                putsUart0("BLOCKED (Any)  ");
+                break;
+            case STATE_BLOCKED_SEND:
+                putsUart0("11: ");
+                putsUart0("BLOCKED (Snd)  ");
+                break;
+            case STATE_BLOCKED_REPLY:
+                putsUart0("12: ");
+                putsUart0("BLOCKED (Rpl)  ");
+                break;
+            case STATE_BLOCKED_RECEIVE:
+                putsUart0("13: ");
+                putsUart0("BLOCKED (Rcv)  ");
+                break;
+            case STATE_BLOCKED_TOPIC:
+                putsUart0("14: ");
+                putsUart0("BLOCKED (Tpc)  ");
+                break;
+            case STATE_BLOCKED_STREAM:
+                putsUart0("15: ");
+                putsUart0("BLOCKED (Str)  ");
+                break;
+            case STATE_BLOCKED_QUEUE:
+                putsUart0("16: ");
+                putsUart0("BLOCKED (Que)  ");
+                break;
+            default:
+                putsUart0("UNKNOWN         ");
+                break;
+            }
 
-                // Print Priority
-                putsUart0("");
-                itoa(info.priority, buffer);
+            // Print remaining ticks
+            if (info->state == STATE_DELAYED)
+            {
+                itoa(info->ticks, buffer);
                 putsUart0(buffer);
-                for (k = 0; k < (11 - strlen(buffer)); k++)
-                    putsUart0(" ");
 
-                if (info.totalTime > 0)
-                {
-                    // calculate percentage of cpu time here
-                    //uint32_t permille = (info.time * 10000) / info.totalTime;
-                    uint32_t permille = info.time;
-                    uint32_t integer = permille / 100;
-                    uint32_t decimal = permille % 100;
-
-                    itoa(integer, buffer);
-                    putsUart0(buffer);
-                    putsUart0(".");
-                    if (decimal < 10)
-                    {
-                        putsUart0("0"); // Leading zero for decimal
-                    }
-                    itoa(decimal, buffer);
-                    putsUart0(buffer);
-                }
-                else
-                {
-                    putsUart0("0.00");
-                }
-                putsUart0("\n");
+                // Calculate padding (Header is roughly 15 chars wide + 3 spacing)
+                for (k = 0; k < (18 - strlen(buffer)); k++)
+                    putsUart0(" ");
+            }
+            else
+            {
+                putsUart0("                  "); // 0 + 17 spaces
             }
+
+            // Print Priority
+            putsUart0("");
+            itoa(info->priority, buffer);
+            putsUart0(buffer);
+            for (k = 0; k < (11 - strlen(buffer)); k++)
+                putsUart0(" ");
+
+            printUsage(info->usage, 8);
+            printUsage(info->usage10s, 8);
+            printUsage(info->usage60s, 0);
+            putsUart0("\n");
         }
     }
 }
 
-void ipcs(void)
+// refreshes cpu usage over each period until a key is pressed
+// one snapshot trap per refresh keeps the monitor from skewing the figures
+void top(SystemSnapshot *snapshot, uint32_t periodMs)
 {
-    char buffer[12];
+    TaskInfo *info;
+    uint64_t lastCycles[MAX_TASKS];
+    uint32_t lastCount;
+    uint32_t elapsed;
+    uint64_t delta;
+    char buffer[16];
+    char key;
     int i;
     int k;
 
-    // Mutexes
-    putsUart0("Mutexes\n");
-    putsUart0("-------------------------------------------------------\n");
-    putsUart0("Ref   Lock Status   Owner   Queue Size   Queue\n");
-    putsUart0("---   -----------   -----   ----------   --------------\n");
+    getSnapshot(snapshot);
+    for (i = 0; i < MAX_TASKS; i++)
+    {
+        lastCycles[i] = snapshot->tasks[i].cycles;
+    }
+    lastCount = snapshot->cycleCount;
 
-    MutexInfo mInfo;
-    for (i = 0; i < MAX_MUTEXES; i++)
+    while (streamRead(uartRx, &key, 1, false) == 0)
     {
-        if (getResourceInfo(0, i, &mInfo))
-        {
-            // idx print
-            itoa(i, buffer);
-            putsUart0(buffer);
-            for (k = 0; k < (6 - strlen(buffer)); k++)
-                putsUart0(" ");
+        sleep(periodMs);
+        getSnapshot(snapshot);
+        elapsed = snapshot->cycleCount - lastCount;
+        lastCount = snapshot->cycleCount;
+
+        putsUart0("\033[2J\033[H");
+        putsUart0("top - ");
+        itoa(snapshot->taskCount, buffer);
+        putsUart0(buffer);
+        putsUart0(" tasks, ");
+        itoa(periodMs, buffer);
+        putsUart0(buffer);
+        putsUart0(" ms refresh, press any key to exit\n\n");
+        putsUart0("PID     Name         Priority   CPU %   CPU 60s\n");
+        putsUart0("---     -----------  --------   -----   -------\n");
 
-            // lock state print
-            if (mInfo.lock)
+        for (i = 0; i < MAX_TASKS; i++)
+        {
+            info = &snapshot->tasks[i];
+            if (info->state == STATE_INVALID)
             {
-                putsUart0("Locked\t");
-                for (k = 0; k < (5 - strlen(mInfo.lock)); k++)
-                    putsUart0(" ");
+                continue;
             }
 
-            else
+            // counters restart when a task is restarted
+            delta = info->cycles;
+            if (info->cycles >= lastCycles[i])
             {
-                putsUart0("Unlocked\t");
-                for (k = 0; k < (3 - strlen(mInfo.lock)); k++)
-                    putsUart0(" ");
+                delta -= lastCycles[i];
             }
+            lastCycles[i] = info->cycles;
 
-            // owner print
-            itoa(mInfo.lockedBy, buffer);
+            itoa(info->pid, buffer);
             putsUart0(buffer);
             for (k = 0; k < (8 - strlen(buffer)); k++)
                 putsUart0(" ");
 
-            // qeuue size print
-            itoa(mInfo.queueSize, buffer);
-            putsUart0(buffer);
-            for (k = 0; k < (13 - strlen(buffer)); k++)
+            putsUart0(info->name);
+            for (k = 0; k < (13 - strlen(info->name)); k++)
                 putsUart0(" ");
 
-            for (k = 0; k < mInfo.queueSize; k++)
-            {
-                itoa(mInfo.processQueue[k], buffer);
-                putsUart0(buffer);
+            itoa(info->priority, buffer);
+            putsUart0(buffer);
+            for (k = 0; k < (11 - strlen(buffer)); k++)
                 putsUart0(" ");
-            }
+
+            printUsage(elapsed ? (uint32_t) ((delta * 10000) / elapsed) : 0, 8);
+            printUsage(info->usage60s, 0);
+            putsUart0("\n");
+        }
+    }
+}
+
+// prints a cycle count in microseconds, padded to width
+void printCyclesUs(uint64_t cycles, int width)
+{
+    char buffer[12];
+    int k;
+
+    itoa((uint32_t) (cycles / 40), buffer);
+    putsUart0(buffer);
+    for (k = 0; k < (width - (int) strlen(buffer)); k++)
+        putsUart0(" ");
+}
+
+void printLockStats(const char type[], int index, LockStats *stats)
+{
+    char buffer[12];
+    int k;
+
+    putsUart0((char*) type);
+    itoa(index, buffer);
+    putsUart0(buffer);
+    for (k = 0; k < (6 - strlen(buffer)); k++)
+        putsUart0(" ");
+
+    itoa(stats->acquisitions, buffer);
+    putsUart0(buffer);
+    for (k = 0; k < (10 - strlen(buffer)); k++)
+        putsUart0(" ");
+
+    itoa(stats->contentions, buffer);
+    putsUart0(buffer);
+    for (k = 0; k < (11 - strlen(buffer)); k++)
+        putsUart0(" ");
+
+    if (stats->contentions > 0)
+        printCyclesUs(stats->totalWait / stats->contentions, 13);
+    else
+        printCyclesUs(0, 13);
+    printCyclesUs(stats->maxWait, 13);
+    printCyclesUs(stats->maxHold, 0);
+    putsUart0("\n");
+}
+
+// prints the tasks in a set, padded to width
+void printTaskSet(uint16_t tasks, int width)
+{
+    char buffer[12];
+    int used = 0;
+    int i;
+    for (i = 0; i < MAX_TASKS; i++)
+    {
+        if (tasks & (1 << i))
+        {
+            itoa(i, buffer);
+            putsUart0(buffer);
+            putsUart0(" ");
+            used += strlen(buffer) + 1;
+        }
+    }
+    for (; used < width; used++)
+        putsUart0(" ");
+}
+
+void ipcs(SystemSnapshot *snapshot)
+{
+    MutexInfo *mInfo;
+    SemaphoreInfo *sInfo;
+    RwLockInfo *rInfo;
+    ConditionInfo *cInfo;
+    TopicInfo *tInfo;
+    StreamInfo *bInfo;
+    QueueInfo *qInfo;
+    char buffer[12];
+    int i;
+    int k;
+
+    getSnapshot(snapshot);
+
+    // Mutexes
+    putsUart0("Mutexes\n");
+    putsUart0("---------------------------------------------------------------\n");
+    putsUart0("Ref   Lock Status   Owner   Depth   Queue Size   Queue\n");
+    putsUart0("---   -----------   -----   -----   ----------   --------------\n");
+
+    // only live objects are in the snapshot, ref is the pool slot
+    for (i = 0; i < snapshot->mutexCount; i++)
+    {
+        mInfo = &snapshot->mutexes[i];
+        // idx print
+        itoa(HANDLE_SLOT(mInfo->ref), buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (6 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        // lock state print
+        if (mInfo->lock)
+        {
+            putsUart0("Locked        ");
+        }
+
+        else
+        {
+            putsUart0("Unlocked      ");
+        }
+
+        // owner print
+        itoa(mInfo->lockedBy, buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (8 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        // recursion depth print, only recursive mutexes nest
+        if (!mInfo->recursive)
+            strcpy(buffer, "-");
+        else if (mInfo->lock)
+            itoa(mInfo->recursion + 1, buffer);
+        else
+            itoa(0, buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (8 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        // qeuue size print
+        itoa(mInfo->queueSize, buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (13 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        for (k = 0; k < mInfo->queueSize; k++)
+        {
+            itoa(mInfo->processQueue[k], buffer);
+            putsUart0(buffer);
+            putsUart0(" ");
         }
     }
 
@@ -224,38 +416,296 @@ void ipcs(void)
     putsUart0("Ref   Count   Queue Size   Queue\n");
     putsUart0("---   -----   ----------   -----\n");
 
-    SemaphoreInfo sInfo;
-    for (i = 0; i < MAX_SEMAPHORES; i++)
+    for (i = 0; i < snapshot->semaphoreCount; i++)
     {
-        if (getResourceInfo(1, i, &sInfo))
+        sInfo = &snapshot->semaphores[i];
+        // idx print
+        itoa(HANDLE_SLOT(sInfo->ref), buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (6 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        // count print
+        itoa(sInfo->count, buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (8 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        // queue size print
+        itoa(sInfo->queueSize, buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (13 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        for (k = 0; k < sInfo->queueSize; k++)
         {
-            // idx print
-            itoa(i, buffer);
+            itoa(sInfo->processQueue[k], buffer);
             putsUart0(buffer);
-            for (k = 0; k < (6 - strlen(buffer)); k++)
-                putsUart0(" ");
+            putsUart0(" ");
+        }
+
+        putsUart0("\n");
+    }
+
+    // RW locks
+    putsUart0("\nRW Locks\n");
+    putsUart0("---------------------------------------------------------\n");
+    putsUart0("Ref   State    Readers   Writer   Writers Waiting   Queue\n");
+    putsUart0("---   -----    -------   ------   ---------------   -----\n");
+
+    for (i = 0; i < snapshot->rwlockCount; i++)
+    {
+        rInfo = &snapshot->rwlocks[i];
+        itoa(HANDLE_SLOT(rInfo->ref), buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (6 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        if (rInfo->writeLocked)
+            putsUart0("Write    ");
+        else if (rInfo->readerCount > 0)
+            putsUart0("Read     ");
+        else
+            putsUart0("Free     ");
 
-            // count print
-            itoa(sInfo.count, buffer);
+        itoa(rInfo->readerCount, buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (10 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        if (rInfo->writeLocked)
+            itoa(rInfo->writer, buffer);
+        else
+            strcpy(buffer, "-");
+        putsUart0(buffer);
+        for (k = 0; k < (9 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        itoa(rInfo->writersWaiting, buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (18 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        for (k = 0; k < rInfo->queueSize; k++)
+        {
+            itoa(rInfo->processQueue[k], buffer);
             putsUart0(buffer);
-            for (k = 0; k < (8 - strlen(buffer)); k++)
-                putsUart0(" ");
+            putsUart0(" ");
+        }
 
-            // queue size print
-            itoa(sInfo.queueSize, buffer);
+        putsUart0("\n");
+    }
+
+    // Conditions
+    putsUart0("\nConditions\n");
+    putsUart0("-------------------------------\n");
+    putsUart0("Ref   Mutex   Waiters   Queue\n");
+    putsUart0("---   -----   -------   -----\n");
+
+    for (i = 0; i < snapshot->conditionCount; i++)
+    {
+        cInfo = &snapshot->conditions[i];
+        itoa(HANDLE_SLOT(cInfo->ref), buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (6 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        itoa(HANDLE_SLOT(cInfo->mutex), buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (8 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        itoa(cInfo->queueSize, buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (10 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        for (k = 0; k < cInfo->queueSize; k++)
+        {
+            itoa(cInfo->processQueue[k], buffer);
             putsUart0(buffer);
-            for (k = 0; k < (13 - strlen(buffer)); k++)
-                putsUart0(" ");
+            putsUart0(" ");
+        }
 
-            for (k = 0; k < sInfo.queueSize; k++)
-            {
-                itoa(sInfo.processQueue[k], buffer);
-                putsUart0(buffer);
-                putsUart0(" ");
-            }
+        putsUart0("\n");
+    }
 
-            putsUart0("\n");
+    // Topics
+    putsUart0("\nTopics\n");
+    putsUart0("-----------------------------------------------\n");
+    putsUart0("Ref   Size   Published    Subscribers (unread)\n");
+    putsUart0("---   ----   ---------    --------------------\n");
+
+    for (i = 0; i < snapshot->topicCount; i++)
+    {
+        tInfo = &snapshot->topics[i];
+        itoa(HANDLE_SLOT(tInfo->ref), buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (6 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        itoa(tInfo->sampleSize, buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (7 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        itoa(tInfo->sequence, buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (13 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        for (k = 0; k < tInfo->subscriberCount; k++)
+        {
+            itoa(tInfo->subscribers[k], buffer);
+            putsUart0(buffer);
+            putsUart0("(");
+            itoa(tInfo->pending[k], buffer);
+            putsUart0(buffer);
+            putsUart0(") ");
         }
+
+        putsUart0("\n");
+    }
+
+    // Streams
+    putsUart0("\nStreams\n");
+    putsUart0("--------------------------------------------\n");
+    putsUart0("Ref   Buffered   Trigger   Reader   Writers\n");
+    putsUart0("---   --------   -------   ------   -------\n");
+
+    for (i = 0; i < snapshot->streamCount; i++)
+    {
+        bInfo = &snapshot->streams[i];
+        itoa(HANDLE_SLOT(bInfo->ref), buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (6 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        itoa(bInfo->count, buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (11 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        itoa(bInfo->trigger, buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (10 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        if (bInfo->reader < MAX_TASKS)
+            itoa(bInfo->reader, buffer);
+        else
+            strcpy(buffer, "-");
+        putsUart0(buffer);
+        for (k = 0; k < (9 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        printTaskSet(bInfo->writers, 0);
+        putsUart0("\n");
+    }
+
+    // Queues
+    putsUart0("\nMessage Queues\n");
+    putsUart0("-------------------------------------------------------\n");
+    putsUart0("Ref   Size   Queued   Next Prio   Senders   Receivers\n");
+    putsUart0("---   ----   ------   ---------   -------   ---------\n");
+
+    for (i = 0; i < snapshot->queueCount; i++)
+    {
+        qInfo = &snapshot->queues[i];
+        itoa(HANDLE_SLOT(qInfo->ref), buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (6 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        itoa(qInfo->messageSize, buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (7 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        itoa(qInfo->count, buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (9 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        if (qInfo->count > 0)
+            itoa(qInfo->urgent, buffer);
+        else
+            strcpy(buffer, "-");
+        putsUart0(buffer);
+        for (k = 0; k < (12 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        printTaskSet(qInfo->senders, 10);
+        printTaskSet(qInfo->receivers, 0);
+        putsUart0("\n");
+    }
+
+    // Contention
+    putsUart0("\nContention (times in us)\n");
+    putsUart0("--------------------------------------------------------------\n");
+    putsUart0("Ref     Acquired  Contended  Avg Wait     Max Wait     Max Hold\n");
+    putsUart0("---     --------  ---------  --------     --------     --------\n");
+
+    for (i = 0; i < snapshot->mutexCount; i++)
+    {
+        printLockStats("M", HANDLE_SLOT(snapshot->mutexes[i].ref),
+                       &snapshot->mutexes[i].stats);
+    }
+    for (i = 0; i < snapshot->semaphoreCount; i++)
+    {
+        printLockStats("S", HANDLE_SLOT(snapshot->semaphores[i].ref),
+                       &snapshot->semaphores[i].stats);
+    }
+    for (i = 0; i < snapshot->rwlockCount; i++)
+    {
+        printLockStats("R", HANDLE_SLOT(snapshot->rwlocks[i].ref),
+                       &snapshot->rwlocks[i].stats);
+    }
+}
+
+void shm(SystemSnapshot *snapshot)
+{
+    ShmInfo *info;
+    char buffer[12];
+    int i;
+    int k;
+
+    getSnapshot(snapshot);
+
+    putsUart0("Shared Memory\n");
+    putsUart0("-----------------------------------------------------------------------\n");
+    putsUart0("Ref   Name          Base          Size    Owner   Read Only   Read Write\n");
+    putsUart0("---   ----          ----          ----    -----   ---------   ----------\n");
+
+    for (i = 0; i < snapshot->shmCount; i++)
+    {
+        info = &snapshot->shms[i];
+        itoa(HANDLE_SLOT(info->ref), buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (6 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        putsUart0(info->name);
+        for (k = 0; k < (14 - strlen(info->name)); k++)
+            putsUart0(" ");
+
+        itoh_be((uint32_t) info->base, buffer);
+        putsUart0(buffer);
+        putsUart0("   ");
+
+        itoa(info->size, buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (8 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        itoa(info->owner, buffer);
+        putsUart0(buffer);
+        for (k = 0; k < (8 - strlen(buffer)); k++)
+            putsUart0(" ");
+
+        printTaskSet(info->readers, 12);
+        printTaskSet(info->writers, 0);
+        putsUart0("\n");
     }
 }
 
@@ -352,6 +802,253 @@ void run(const char name[])
 
 }
 
+// writes raw bytes, used for binary dumps
+void putBytesUart0(const void *data, uint32_t size)
+{
+    const uint8_t *bytes = (const uint8_t*) data;
+    uint32_t i;
+    for (i = 0; i < size; i++)
+    {
+        putcUart0(bytes[i]);
+    }
+}
+
+// binary trace dump, decoded on the host by tools/trace2perfetto.py
+// header: magic, version, cpu hz, task count
+// then task count 16-byte names, then records, then an end record
+void traceDump(void)
+{
+    TraceRecord records[8];
+    TaskInfo info;
+    uint32_t header[4] = { TRACE_MAGIC, TRACE_VERSION, 40000000, MAX_TASKS };
+    char name[16];
+    uint32_t first = 0;
+    uint32_t count;
+    int i;
+    int k;
+
+    // freeze the ring so the dump is consistent
+    uint32_t mask = setTraceMask(0);
+
+    putBytesUart0(header, sizeof(header));
+    for (i = 0; i < MAX_TASKS; i++)
+    {
+        for (k = 0; k < 16; k++)
+            name[k] = '\0';
+        if (populateTaskInfo(i, &info))
+            strncpy(name, info.name, 16);
+        putBytesUart0(name, 16);
+    }
+
+    do
+    {
+        count = readTrace(first, records, 8);
+        putBytesUart0(records, count * sizeof(TraceRecord));
+        first += count;
+    }
+    while (count != 0);
+
+    records[0].time = 0;
+    records[0].type = 0xFF;
+    records[0].task = 0xFF;
+    records[0].arg = 0xFFFF;
+    putBytesUart0(records, sizeof(TraceRecord));
+
+    setTraceMask(mask);
+}
+
+void trace(const char param[])
+{
+    if (stricmp(param, "on") == 0)
+    {
+        setTraceMask(TRACE_MASK_DEFAULT);
+        putsUart0("trace on\n");
+    }
+    else if (stricmp(param, "all") == 0)
+    {
+        setTraceMask(TRACE_MASK_ALL);
+        putsUart0("trace on (with ticks)\n");
+    }
+    else if (stricmp(param, "off") == 0)
+    {
+        setTraceMask(0);
+        putsUart0("trace off\n");
+    }
+    else if (stricmp(param, "clear") == 0)
+    {
+        clearTrace();
+        putsUart0("trace cleared\n");
+    }
+    else if (stricmp(param, "dump") == 0)
+    {
+        traceDump();
+    }
+    else
+    {
+        putsUart0("usage: trace on|all|off|clear|dump\n");
+    }
+}
+
+// upper bound in cycles of the bucket holding the given percentile
+uint32_t latencyPercentile(LatencyInfo *info, uint32_t percent)
+{
+    uint32_t target = (info->count * percent + 99) / 100;
+    uint32_t seen = 0;
+    int k;
+    for (k = 0; k < LATENCY_BUCKETS - 1; k++)
+    {
+        seen += info->buckets[k];
+        if (seen >= target)
+        {
+            break;
+        }
+    }
+    return (k == LATENCY_BUCKETS - 1) ? info->max : 1 << (k + LATENCY_MIN_SHIFT);
+}
+
+// wake-to-run latency, summary of all tasks or histogram of one
+void latency(SystemSnapshot *snapshot, const char name[])
+{
+    LatencyInfo info;
+    char buffer[12];
+    int i;
+    int k;
+
+    if (name == NULL)
+    {
+        getSnapshot(snapshot);
+        putsUart0("Wake-to-run latency (us, percentiles are bucket upper bounds)\n");
+        putsUart0("Name         Wakes       p50          p99          Max\n");
+        putsUart0("-----------  ----------  -----------  -----------  -----------\n");
+        for (i = 0; i < MAX_TASKS; i++)
+        {
+            if (snapshot->tasks[i].state == STATE_INVALID
+                    || !getLatencyInfo(i, &info))
+            {
+                continue;
+            }
+            putsUart0(snapshot->tasks[i].name);
+            for (k = 0; k < (13 - strlen(snapshot->tasks[i].name)); k++)
+                putsUart0(" ");
+            itoa(info.count, buffer);
+            putsUart0(buffer);
+            for (k = 0; k < (12 - strlen(buffer)); k++)
+                putsUart0(" ");
+            if (info.count > 0)
+            {
+                printCyclesUs(latencyPercentile(&info, 50), 13);
+                printCyclesUs(latencyPercentile(&info, 99), 13);
+            }
+            else
+            {
+                printCyclesUs(0, 13);
+                printCyclesUs(0, 13);
+            }
+            printCyclesUs(info.max, 0);
+            putsUart0("\n");
+        }
+        return;
+    }
+
+    i = getPid(name);
+    if (i == -1 || !getLatencyInfo(i, &info))
+    {
+        putsUart0("Process not found\n");
+        return;
+    }
+    putsUart0("Below (us)   Count\n");
+    putsUart0("-----------  ----------\n");
+    for (k = 0; k < LATENCY_BUCKETS; k++)
+    {
+        if (k == LATENCY_BUCKETS - 1)
+        {
+            putsUart0("above        ");
+        }
+        else
+        {
+            printCyclesUs(1 << (k + LATENCY_MIN_SHIFT), 13);
+        }
+        itoa(info.buckets[k], buffer);
+        putsUart0(buffer);
+        putsUart0("\n");
+    }
+}
+
+// text dump, symbolized on the host by tools/profsym.py
+// one "address count" line per non-empty bucket
+void profileDump(void)
+{
+    ProfileInfo info;
+    uint16_t counts[16];
+    uint32_t first = 0;
+    uint32_t count;
+    char buffer[12];
+    uint32_t i;
+
+    getProfileInfo(&info);
+    putsUart0("PROFILE shift=");
+    itoa(info.shift, buffer);
+    putsUart0(buffer);
+    putsUart0(" samples=");
+    itoa(info.samples, buffer);
+    putsUart0(buffer);
+    putsUart0(" overflow=");
+    itoa(info.overflow, buffer);
+    putsUart0(buffer);
+    putsUart0(" kernel=");
+    itoa(info.kernel, buffer);
+    putsUart0(buffer);
+    putsUart0("\n");
+
+    do
+    {
+        count = readProfile(first, counts, 16);
+        for (i = 0; i < count; i++)
+        {
+            if (counts[i] != 0)
+            {
+                itoh_be((first + i) << info.shift, buffer);
+                putsUart0(buffer);
+                putsUart0(" ");
+                itoa(counts[i], buffer);
+                putsUart0(buffer);
+                putsUart0("\n");
+            }
+        }
+        first += count;
+    }
+    while (count != 0);
+    putsUart0("END\n");
+}
+
+void profile(USER_DATA *data)
+{
+    char *param = getFieldString(data, 1);
+    if (stricmp(param, "on") == 0)
+    {
+        uint8_t shift = PROFILE_SHIFT_DEFAULT;
+        if (data->fieldCount > 2)
+        {
+            shift = getFieldInteger(data, 2);
+        }
+        setProfiling(true, shift);
+        putsUart0("profile on\n");
+    }
+    else if (stricmp(param, "off") == 0)
+    {
+        setProfiling(false, 0);
+        putsUart0("profile off\n");
+    }
+    else if (stricmp(param, "dump") == 0)
+    {
+        profileDump();
+    }
+    else
+    {
+        putsUart0("usage: profile on [shift]|off|dump\n");
+    }
+}
+
 void shell(void)
 {
     USER_DATA data;
@@ -359,14 +1056,27 @@ void shell(void)
     uint8_t i = 0;
     char c;
     bool entered = false;
+    char input[16];
+    uint8_t inputCount = 0;
+    uint8_t inputIndex = 0;
+
+    // one heap buffer for every snapshot command, it is too big for the
+    // shell stack and the shell cannot reach kernel statics
+    SystemSnapshot *snapshot = bufferAlloc(sizeof(SystemSnapshot));
+    if (snapshot == NULL)
+    {
+        putsUart0("\r\nno memory for snapshots, ps/top/ipcs/shm/latency are off");
+    }
 
     putsUart0("\r\n> ");
 
     while (true)
     {
-        while (!kbhitUart0())
+        // typed characters come a batch per wakeup from the uart rx stream
+        if (inputIndex == inputCount)
         {
-            sleep(10);
+            inputCount = streamRead(uartRx, input, sizeof(input), true);
+            inputIndex = 0;
         }
 
         // Shell operates as a two-state machine via the "entered" flag
@@ -375,9 +1085,9 @@ void shell(void)
         //
         // It is crucial to use two separate 'if' statements rather than an 'if-else' to allow
         // instant transition from input buffering to command execution.
-        if (!entered)
+        if (!entered && inputIndex < inputCount)
         {
-            c = getcUart0();
+            c = input[inputIndex++];
             if ((c == 8 || c == 127) && count > 0)
             {
                 count--;
@@ -415,16 +1125,45 @@ void shell(void)
                 reboot();
             }
 
-            if (isCommand(&data, "ps", 0))
+            if (isCommand(&data, "ps", 0) && snapshot != NULL)
             {
                 valid = true;
-                ps();
+                ps(snapshot);
+            }
+
+            if (isCommand(&data, "top", 0) && snapshot != NULL)
+            {
+                uint32_t periodMs = 1000;
+                if (data.fieldCount > 1)
+                {
+                    periodMs = getFieldInteger(&data, 1);
+                }
+                if (periodMs > 0)
+                {
+                    valid = true;
+                    top(snapshot, periodMs);
+                }
             }
 
-            if (isCommand(&data, "ipcs", 0))
+            if (isCommand(&data, "ipcs", 0) && snapshot != NULL)
             {
                 valid = true;
-                ipcs();
+                if (data.fieldCount > 1
+                        && stricmp(getFieldString(&data, 1), "reset") == 0)
+                {
+                    resetLockStats();
+                    putsUart0("ipcs statistics reset\n");
+                }
+                else
+                {
+                    ipcs(snapshot);
+                }
+            }
+
+            if (isCommand(&data, "shm", 0) && snapshot != NULL)
+            {
+                valid = true;
+                shm(snapshot);
             }
 
             if (isCommand(&data, "kill", 1))
@@ -543,6 +1282,50 @@ void shell(void)
                 run(proc_name);
             }
 
+            if (isCommand(&data, "trace", 1))
+            {
+                char *param = getFieldString(&data, 1);
+                valid = true;
+                trace(param);
+            }
+
+            if (isCommand(&data, "profile", 1))
+            {
+                valid = true;
+                profile(&data);
+            }
+
+            if (isCommand(&data, "latency", 0) && snapshot != NULL)
+            {
+                valid = true;
+                if (data.fieldCount == 1)
+                {
+                    latency(snapshot, NULL);
+                }
+                else if (stricmp(getFieldString(&data, 1), "reset") == 0)
+                {
+                    resetLatency();
+                    putsUart0("latency histograms reset\n");
+                }
+                else
+                {
+                    latency(snapshot, getFieldString(&data, 1));
+                }
+            }
+
+            if (isCommand(&data, "pingpong", 0))
+            {
+                valid = true;
+                // the Ping task prints the result when it finishes
+                post(benchStart);
+            }
+
+            if (isCommand(&data, "ipccheck", 0))
+            {
+                valid = true;
+                post(benchCheck);
+            }
+
             if (isCommand(&data, "hard", 0))
             {
                 valid = true;
@@ -16,7 +16,8 @@
 
 #include <stdbool.h>
 
-
+// kernel.h includes this header before it defines SystemSnapshot
+struct _system_snapshot;
 
 //-----------------------------------------------------------------------------
 // Subroutines
@@ -24,8 +25,12 @@
 
 void yield(void);
 void reboot(void);
-void ps(void);
-void ipcs(void);
+void printUsage(uint32_t usage, int width);
+void ps(struct _system_snapshot *snapshot);
+void top(struct _system_snapshot *snapshot, uint32_t periodMs);
+void printCyclesUs(uint64_t cycles, int width);
+void ipcs(struct _system_snapshot *snapshot);
+void shm(struct _system_snapshot *snapshot);
 void kill(uint32_t pid);
 void pkill(const char name[]);
 void pi(bool on);
@@ -33,6 +38,11 @@ void preempt(bool on);
 void sched(bool prio_on);
 void pidof(const char name[]);
 void run(const char name[]);
+void putBytesUart0(const void *data, uint32_t size);
+void traceDump(void);
+void trace(const char param[]);
+void profileDump(void);
+void latency(struct _system_snapshot *snapshot, const char name[]);
 void shell(void);
 
 #endif
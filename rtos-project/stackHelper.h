@@ -11,7 +11,7 @@
 //-----------------------------------------------------------------------------
 
 extern void loadR3(uint32_t value);
-extern void setPC(void);
+extern void setPC(uint32_t arg, uint32_t pc);
 
 extern uint32_t * saveContext(void);
 extern void restoreContext(uint32_t * sp);
@@ -24,5 +24,10 @@ extern void setMsp(void * msp);
 
 extern void setAspBit(void);
 extern void setTMPL(void);
+extern void clearTMPL(void);
+
+extern uint32_t getBasepri(void);
+extern void setBasepri(uint32_t basepri);
+extern void raiseBasepri(uint32_t basepri);
 
 #endif
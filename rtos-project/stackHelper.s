@@ -20,7 +20,11 @@
     .global setMsp
     .global setAspBit
     .global setTMPL
+    .global clearTMPL
     .global launchFirstTask
+    .global getBasepri
+    .global setBasepri
+    .global raiseBasepri
 
     .sect   ".text"
     .thumb
@@ -35,7 +39,7 @@ loadR3:
     BX LR
 
 setPC:
-	BX R3
+	BX R1          	; R0 already holds the task arg
 
 saveContext:
 	MRS R0, PSP
@@ -81,4 +85,24 @@ setTMPL:
 	MSR CONTROL, R0
 	BX LR
 
+clearTMPL:
+	MRS R0, CONTROL
+	BIC	R0, R0, #1
+	MSR CONTROL, R0
+	BX LR
+
+getBasepri:
+	MRS R0, BASEPRI
+	BX LR
 
+setBasepri:
+	MSR BASEPRI, R0
+	ISB
+	BX LR
+
+; BASEPRI_MAX only takes the write if it raises the mask, so a nested
+; critical section never unmasks what an outer one masked
+raiseBasepri:
+	MSR BASEPRI_MAX, R0
+	ISB
+	BX LR
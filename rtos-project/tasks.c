@@ -63,12 +63,13 @@ void initHw(void)
     enablePinPulldown(BUTTON5);
     enablePinPulldown(BUTTON6);
 
-    selectPinInterruptFallingEdge(BUTTON1);
-    selectPinInterruptFallingEdge(BUTTON2);
-    selectPinInterruptFallingEdge(BUTTON3);
-    selectPinInterruptFallingEdge(BUTTON4);
-    selectPinInterruptFallingEdge(BUTTON5);
-    selectPinInterruptFallingEdge(BUTTON6);
+    // pushbuttons are pulled down, so a press is a rising edge
+    selectPinInterruptRisingEdge(BUTTON1);
+    selectPinInterruptRisingEdge(BUTTON2);
+    selectPinInterruptRisingEdge(BUTTON3);
+    selectPinInterruptRisingEdge(BUTTON4);
+    selectPinInterruptRisingEdge(BUTTON5);
+    selectPinInterruptRisingEdge(BUTTON6);
 
     clearPinInterrupt(BUTTON1);
     clearPinInterrupt(BUTTON2);
@@ -77,6 +78,10 @@ void initHw(void)
     clearPinInterrupt(BUTTON5);
     clearPinInterrupt(BUTTON6);
 
+    // pbIsr posts a semaphore, so it must sit at or below the kernel threshold
+    setNvicInterruptPriority(INT_GPIOA, PRIORITY_GPIO);
+    setNvicInterruptPriority(INT_GPIOB, PRIORITY_GPIO);
+    setNvicInterruptPriority(INT_GPIOE, PRIORITY_GPIO);
     enableNvicInterrupt(INT_GPIOA);
     enableNvicInterrupt(INT_GPIOB);
     enableNvicInterrupt(INT_GPIOE);
@@ -95,6 +100,71 @@ void initHw(void)
     NVIC_CFG_CTRL_R |= NVIC_CFG_CTRL_DIV0;
 }
 
+void clearPbInterrupts(void)
+{
+    clearPinInterrupt(BUTTON1);
+    clearPinInterrupt(BUTTON2);
+    clearPinInterrupt(BUTTON3);
+    clearPinInterrupt(BUTTON4);
+    clearPinInterrupt(BUTTON5);
+    clearPinInterrupt(BUTTON6);
+}
+
+// edges latched while masked (release bounce) are dropped first
+void enablePbInterrupts(void)
+{
+    clearPbInterrupts();
+    enablePinInterrupt(BUTTON1);
+    enablePinInterrupt(BUTTON2);
+    enablePinInterrupt(BUTTON3);
+    enablePinInterrupt(BUTTON4);
+    enablePinInterrupt(BUTTON5);
+    enablePinInterrupt(BUTTON6);
+}
+
+void disablePbInterrupts(void)
+{
+    disablePinInterrupt(BUTTON1);
+    disablePinInterrupt(BUTTON2);
+    disablePinInterrupt(BUTTON3);
+    disablePinInterrupt(BUTTON4);
+    disablePinInterrupt(BUTTON5);
+    disablePinInterrupt(BUTTON6);
+}
+
+// GPIO port A and E handler
+// one edge is enough to wake readKeys, further bounces are masked until
+// readKeys re-arms the interrupts
+void pbIsr(void)
+{
+    disablePbInterrupts();
+    clearPbInterrupts();
+    postFromIsr(keyInterrupt);
+}
+
+// received bytes go to the uartRx stream, call once it has been created
+void enableUart0RxInterrupt(void)
+{
+    UART0_IFLS_R = (UART0_IFLS_R & ~UART_IFLS_RX_M) | UART_IFLS_RX4_8;
+    UART0_IM_R |= UART_IM_RXIM | UART_IM_RTIM;
+    setNvicInterruptPriority(INT_UART0, PRIORITY_UART);
+    enableNvicInterrupt(INT_UART0);
+}
+
+// drains the rx fifo in one write, so a burst of input wakes the reader
+// once; the receive timeout flushes bytes below the fifo level
+void uart0Isr(void)
+{
+    uint8_t data[16];
+    uint8_t count = 0;
+    UART0_ICR_R = UART_ICR_RXIC | UART_ICR_RTIC;
+    while (!(UART0_FR_R & UART_FR_RXFE) && count < sizeof(data))
+    {
+        data[count++] = UART0_DR_R & 0xFF;
+    }
+    streamWriteFromIsr(uartRx, data, count);
+}
+
 // REQUIRED: add code to return a value from 0-63 indicating which of 6 PBs are pressed
 uint8_t readPbs(void)
 {
@@ -170,12 +240,15 @@ void readKeys(void)
     while(true)
     {
         wait(keyReleased);
-        buttons = 0;
+        buttons = readPbs();
         while (buttons == 0)
         {
+            // pbIsr masks the pins, so re-arm before every wait
+            enablePbInterrupts();
+            wait(keyInterrupt);
             buttons = readPbs();
-            yield();
         }
+        disablePbInterrupts();
         post(keyPressed);
         if ((buttons & 1) != 0)
         {
@@ -206,9 +279,9 @@ void readKeys(void)
 void debounce(void)
 {
     uint8_t count;
+    wait(keyPressed);
     while(true)
     {
-        wait(keyPressed);
         count = 10;
         while (count != 0)
         {
@@ -218,7 +291,7 @@ void debounce(void)
             else
                 count = 10;
         }
-        post(keyReleased);
+        postAndWait(keyReleased, keyPressed);
     }
 }
 
@@ -29,6 +29,12 @@
 //-----------------------------------------------------------------------------
 
 void initHw(void);
+void clearPbInterrupts(void);
+void enablePbInterrupts(void);
+void disablePbInterrupts(void);
+void pbIsr(void);
+void enableUart0RxInterrupt(void);
+void uart0Isr(void);
 
 void idle(void);
 void flash4Hz(void);
@@ -63,6 +63,8 @@ extern void usageFaultIsr(void);
 extern void svCallIsr(void);
 extern void pendSvIsr(void);
 extern void systickIsr(void);
+extern void pbIsr(void);
+extern void uart0Isr(void);
 
 //*****************************************************************************
 //
@@ -91,12 +93,12 @@ void (* const g_pfnVectors[])(void) =
     0,                                      // Reserved
     pendSvIsr,                      // The PendSV handler
     systickIsr,                      // The SysTick handler
-    IntDefaultHandler,                      // GPIO Port A
+    pbIsr,                                  // GPIO Port A
     IntDefaultHandler,                      // GPIO Port B
     IntDefaultHandler,                      // GPIO Port C
     IntDefaultHandler,                      // GPIO Port D
-    IntDefaultHandler,                      // GPIO Port E
-    IntDefaultHandler,                      // UART0 Rx and Tx
+    pbIsr,                                  // GPIO Port E
+    uart0Isr,                               // UART0 Rx and Tx
     IntDefaultHandler,                      // UART1 Rx and Tx
     IntDefaultHandler,                      // SSI0 Rx and Tx
     IntDefaultHandler,                      // I2C0 Master and Slave
@@ -0,0 +1,85 @@
+// Nicholas Nhat Tran
+// 1002027150
+
+// Kernel event trace
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tm4c123gh6pm.h"
+#include "kernel.h"
+#include "trace.h"
+
+//-----------------------------------------------------------------------------
+// Trace Variables
+//-----------------------------------------------------------------------------
+
+TraceRecord traceRing[TRACE_RECORDS];
+uint32_t traceHead = 0;                  // total records ever written
+uint32_t traceMask = TRACE_MASK_DEFAULT; // enabled event types
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// called from handler mode only, oldest records are overwritten
+void traceRecord(uint8_t type, uint8_t task, uint16_t arg)
+{
+    if (traceMask & (1 << type))
+    {
+        TraceRecord *record = &traceRing[traceHead & (TRACE_RECORDS - 1)];
+        record->time = DWT_CYCCNT_R;
+        record->type = type;
+        record->task = task;
+        record->arg = arg;
+        traceHead++;
+    }
+}
+
+void setTraceMaskKernel(uint32_t mask)
+{
+    traceMask = mask;
+}
+
+uint32_t getTraceMaskKernel(void)
+{
+    return traceMask;
+}
+
+void clearTraceKernel(void)
+{
+    traceHead = 0;
+}
+
+// copies up to count records starting at first (0 = oldest still in ring)
+// returns the number of records copied
+uint32_t readTraceKernel(uint32_t first, TraceRecord records[], uint32_t count)
+{
+    uint32_t available = (traceHead < TRACE_RECORDS) ? traceHead : TRACE_RECORDS;
+    uint32_t oldest = traceHead - available;
+    uint32_t i;
+
+    if (first >= available)
+    {
+        return 0;
+    }
+    if (count > available - first)
+    {
+        count = available - first;
+    }
+    for (i = 0; i < count; i++)
+    {
+        records[i] = traceRing[(oldest + first + i) & (TRACE_RECORDS - 1)];
+    }
+    return count;
+}
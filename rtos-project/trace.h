@@ -0,0 +1,73 @@
+// Nicholas Nhat Tran
+// 1002027150
+
+// Kernel event trace
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//-----------------------------------------------------------------------------
+// Trace Defines
+//-----------------------------------------------------------------------------
+
+// ring size in records, must be a power of 2
+#define TRACE_RECORDS 64
+
+// event types (task = subject of event, arg = see comment)
+#define TRACE_SWITCH  0 // task switched in, arg = task switched out
+#define TRACE_SVC     1 // task issued an svc, arg = svc number
+#define TRACE_WAKE    2 // task made ready, arg = TRACE_WAKE_ reason
+#define TRACE_TICK    3 // systick, task = running task
+#define TRACE_ISR     4 // other isr entry, arg = vector number
+
+#define TRACE_WAKE_SLEEP     0
+#define TRACE_WAKE_MUTEX     1
+#define TRACE_WAKE_SEMAPHORE 2
+#define TRACE_WAKE_KILL      3
+#define TRACE_WAKE_NOTIFY    4
+#define TRACE_WAKE_RWLOCK    5
+#define TRACE_WAKE_CONDITION 6
+#define TRACE_WAKE_MESSAGE   7
+#define TRACE_WAKE_TOPIC     8
+#define TRACE_WAKE_STREAM    9
+#define TRACE_WAKE_QUEUE     10
+#define TRACE_WAKE_TIMEOUT   11
+
+// event masks
+#define TRACE_MASK_DEFAULT ((1 << TRACE_SWITCH) | (1 << TRACE_SVC) \
+                            | (1 << TRACE_WAKE) | (1 << TRACE_ISR))
+#define TRACE_MASK_ALL     (TRACE_MASK_DEFAULT | (1 << TRACE_TICK))
+
+// binary dump header
+#define TRACE_MAGIC   0x43525452 // "RTRC" little endian
+#define TRACE_VERSION 1
+
+typedef struct _trace_record
+{
+    uint32_t time;  // DWT cycle count
+    uint8_t type;   // TRACE_ event type
+    uint8_t task;   // tcb index
+    uint16_t arg;   // event argument
+} TraceRecord;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void traceRecord(uint8_t type, uint8_t task, uint16_t arg);
+void setTraceMaskKernel(uint32_t mask);
+uint32_t getTraceMaskKernel(void);
+void clearTraceKernel(void);
+uint32_t readTraceKernel(uint32_t first, TraceRecord records[], uint32_t count);
+
+#endif
@@ -0,0 +1,168 @@
+// Nicholas Nhat Tran
+// 1002027150
+
+// Deferred interrupt work queue and worker pool
+//
+// Isrs queue a small work item and return, the worker task runs the item
+// in privileged thread context at WORK_PRIORITY where it can block, print
+// and be preempted by other interrupts
+//
+// The pool fans jobs from one message queue out to POOL_WORKERS copies of the
+// same task, the most urgent job goes to whichever worker is free first
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "kernel.h"
+#include "stackHelper.h"
+#include "workqueue.h"
+
+//-----------------------------------------------------------------------------
+// Work Queue Variables
+//-----------------------------------------------------------------------------
+
+WorkItem workItems[WORK_LANES][WORK_QUEUE_SIZE];
+uint8_t workHead[WORK_LANES];     // next item to run
+uint8_t workTail[WORK_LANES];     // next free slot
+uint32_t workDropped = 0;         // items lost to a full lane
+int8_t workTask = -1;             // tcb index of the worker
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// creates the worker, call before startRtos
+bool initWorkQueue(void)
+{
+    bool ok = createThread(workQueueTask, "WorkQueue", WORK_PRIORITY,
+                           WORK_STACK);
+    if (ok)
+    {
+        setThreadPrivileged(workQueueTask, true);
+        workTask = getTaskIndex(workQueueTask);
+    }
+    return ok;
+}
+
+bool queueWorkFromIsr(_workFn fn, uint32_t arg, uint8_t lane)
+{
+    bool ok = false;
+    uint32_t basepri;
+
+    if (lane >= WORK_LANES || fn == 0 || workTask < 0)
+    {
+        return false;
+    }
+
+    basepri = enterCritical();
+    if ((uint8_t) (workTail[lane] - workHead[lane]) < WORK_QUEUE_SIZE)
+    {
+        WorkItem *item = &workItems[lane][workTail[lane] & (WORK_QUEUE_SIZE - 1)];
+        item->fn = fn;
+        item->arg = arg;
+        workTail[lane]++;
+        ok = true;
+    }
+    else
+    {
+        workDropped++;
+    }
+    exitCritical(basepri);
+
+    if (ok)
+    {
+        notifyFromIsr(workTask, 0, NOTIFY_GIVE);
+    }
+    return ok;
+}
+
+// takes the next item from the highest priority lane that has one
+bool dequeueWork(WorkItem *item)
+{
+    bool ok = false;
+    uint8_t lane;
+    uint32_t basepri = enterCritical();
+
+    for (lane = 0; lane < WORK_LANES && !ok; lane++)
+    {
+        if (workHead[lane] != workTail[lane])
+        {
+            *item = workItems[lane][workHead[lane] & (WORK_QUEUE_SIZE - 1)];
+            workHead[lane]++;
+            ok = true;
+        }
+    }
+    exitCritical(basepri);
+    return ok;
+}
+
+void workQueueTask(void)
+{
+    WorkItem item;
+    while (true)
+    {
+        notifyTake(NOTIFY_CLEAR_ALL);
+        while (dequeueWork(&item))
+        {
+            item.fn(item.arg);
+        }
+    }
+}
+
+// creates the job queue and the workers, call before startRtos
+bool initWorkerPool(void)
+{
+    bool ok;
+    uint32_t i;
+    char name[] = "Worker0";
+
+    jobQueue = createQueueKernel(sizeof(WorkItem));
+    ok = (jobQueue != INVALID_HANDLE);
+    for (i = 0; i < POOL_WORKERS && ok; i++)
+    {
+        name[6] = '0' + i;
+        ok = createThreadArg(poolWorker, (void*) i, name, POOL_PRIORITY,
+                             POOL_STACK);
+    }
+    return ok;
+}
+
+// queues fn(arg) for the pool, lower priority values run first
+// any task can submit, so the workers run unprivileged, work that needs
+// privilege goes through queueWorkFromIsr
+bool submitJob(_workFn fn, uint32_t arg, uint8_t priority, uint32_t timeout)
+{
+    WorkItem job;
+    if (fn == 0)
+    {
+        return false;
+    }
+    job.fn = fn;
+    job.arg = arg;
+    return queueSend(jobQueue, &job, priority, timeout);
+}
+
+// arg is the worker number, jobs run in the worker's unprivileged context
+// and only reach memory the worker was granted
+void poolWorker(void *arg)
+{
+    WorkItem job;
+    while (true)
+    {
+        if (queueReceive(jobQueue, &job, NULL, QUEUE_FOREVER))
+        {
+            job.fn(job.arg);
+        }
+    }
+}
@@ -0,0 +1,56 @@
+// Nicholas Nhat Tran
+// 1002027150
+
+// Deferred interrupt work queue
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+#ifndef WORKQUEUE_H_
+#define WORKQUEUE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+//-----------------------------------------------------------------------------
+// Work Queue Defines
+//-----------------------------------------------------------------------------
+
+// lanes are drained in order, lane 0 first
+#define WORK_LANES      2
+#define WORK_LANE_HIGH  0
+#define WORK_LANE_LOW   1
+#define WORK_QUEUE_SIZE 8   // items per lane, must be a power of 2
+
+#define WORK_PRIORITY   0   // worker task priority
+#define WORK_STACK      1024
+
+// worker pool, identical workers share one priority queue of jobs
+#define POOL_WORKERS    2
+#define POOL_PRIORITY   6   // same level as the shell, they round-robin
+#define POOL_STACK      1024
+
+typedef void (*_workFn)(uint32_t arg);
+
+typedef struct _work_item
+{
+    _workFn fn;
+    uint32_t arg;
+} WorkItem;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+bool initWorkQueue(void);
+bool queueWorkFromIsr(_workFn fn, uint32_t arg, uint8_t lane);
+void workQueueTask(void);
+bool initWorkerPool(void);
+bool submitJob(_workFn fn, uint32_t arg, uint8_t priority, uint32_t timeout);
+void poolWorker(void *arg);
+
+#endif
@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+# Nicholas Nhat Tran
+# 1002027150
+"""Symbolize a PC-sampling profile dump against the firmware ELF.
+
+Capture:  type "profile on", let it run, then "profile dump" and save the
+          UART output (from the PROFILE line to END) to profile.txt
+Report:   tools/profsym.py profile.txt Debug/rtos-project.out
+
+Each histogram bucket covers 2^shift bytes of flash. A bucket that spans
+several functions is split between them by the number of bytes overlapped.
+"""
+
+import argparse
+import re
+import subprocess
+import sys
+
+
+def read_dump(path):
+    shift = None
+    samples = overflow = kernel = 0
+    buckets = []
+    with open(path, errors="replace") as f:
+        for line in f:
+            line = line.strip()
+            header = re.match(r"PROFILE shift=(\d+) samples=(\d+) overflow=(\d+)"
+                              r"(?: kernel=(\d+))?", line)
+            if header:
+                shift, samples, overflow = map(int, header.groups()[:3])
+                kernel = int(header.group(4) or 0)
+                buckets = []
+                continue
+            if shift is None:
+                continue
+            if line == "END":
+                break
+            entry = re.match(r"0x([0-9A-Fa-f]{4})\.?([0-9A-Fa-f]{4})\s+(\d+)$",
+                             line)
+            if entry:
+                buckets.append((int(entry.group(1) + entry.group(2), 16),
+                                int(entry.group(3))))
+    if shift is None:
+        sys.exit("no PROFILE header found in %s" % path)
+    return shift, samples, overflow, kernel, buckets
+
+
+def read_symbols(elf, nm):
+    out = subprocess.run([nm, "-n", "-S", "--defined-only", elf],
+                         check=True, capture_output=True, text=True).stdout
+    symbols = []
+    for line in out.splitlines():
+        fields = line.split()
+        if len(fields) == 4 and fields[2] in "tTwW":
+            # clear the thumb bit
+            start = int(fields[0], 16) & ~1
+            symbols.append((start, start + int(fields[1], 16), fields[3]))
+    return symbols
+
+
+def attribute(shift, buckets, symbols):
+    size = 1 << shift
+    totals = {}
+    for base, count in buckets:
+        end = base + size
+        covered = 0
+        for start, stop, name in symbols:
+            overlap = min(end, stop) - max(base, start)
+            if overlap > 0:
+                totals[name] = totals.get(name, 0) + count * overlap / size
+                covered += overlap
+        if covered < size:
+            totals["<unknown>"] = (totals.get("<unknown>", 0)
+                                   + count * (size - covered) / size)
+    return totals
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("dump", help="text captured from 'profile dump'")
+    parser.add_argument("elf", help="firmware ELF the profile was taken on")
+    parser.add_argument("--nm", default="arm-none-eabi-nm",
+                        help="nm for the target (default arm-none-eabi-nm)")
+    parser.add_argument("-n", "--top", type=int, default=30,
+                        help="number of functions to show (default 30)")
+    args = parser.parse_args()
+
+    shift, samples, overflow, kernel, buckets = read_dump(args.dump)
+    totals = attribute(shift, buckets, read_symbols(args.elf, args.nm))
+    if kernel:
+        totals["<kernel handlers>"] = kernel
+
+    print("%d samples, %d outside histogram, %d byte buckets"
+          % (samples, overflow, 1 << shift))
+    print("%8s %7s  %s" % ("samples", "%", "function"))
+    ranked = sorted(totals.items(), key=lambda item: item[1], reverse=True)
+    for name, count in ranked[:args.top]:
+        percent = 100.0 * count / samples if samples else 0.0
+        print("%8.1f %6.2f%%  %s" % (count, percent, name))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+# Nicholas Nhat Tran
+# 1002027150
+
+"""Convert a kernel trace dump captured from UART0 to Perfetto JSON.
+
+Capture:  stty -F /dev/ttyACM0 115200 raw && cat /dev/ttyACM0 > trace.bin
+          (type "trace dump" in the shell, then stop cat)
+Convert:  tools/trace2perfetto.py trace.bin -o trace.json
+View:     open trace.json at https://ui.perfetto.dev
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+TRACE_MAGIC = 0x43525452
+TRACE_VERSION = 1
+
+TRACE_SWITCH = 0
+TRACE_SVC = 1
+TRACE_WAKE = 2
+TRACE_TICK = 3
+TRACE_ISR = 4
+TRACE_END = 0xFF
+
+WAKE_REASONS = {0: "sleep", 1: "mutex", 2: "semaphore", 3: "kill",
+                4: "notify", 5: "rwlock",
+                6: "condition", 7: "message", 8: "topic",
+                9: "stream", 10: "queue", 11: "timeout"}
+
+HEADER = struct.Struct("<IIII")
+RECORD = struct.Struct("<IBBH")
+NAME_SIZE = 16
+
+
+def parse(data):
+    start = data.find(struct.pack("<I", TRACE_MAGIC))
+    if start < 0:
+        sys.exit("trace header not found in capture")
+
+    magic, version, hz, tasks = HEADER.unpack_from(data, start)
+    if version != TRACE_VERSION:
+        sys.exit("unsupported trace version %d" % version)
+    offset = start + HEADER.size
+
+    names = []
+    for i in range(tasks):
+        raw = data[offset:offset + NAME_SIZE]
+        names.append(raw.split(b"\0", 1)[0].decode("ascii", "replace"))
+        offset += NAME_SIZE
+
+    records = []
+    while offset + RECORD.size <= len(data):
+        time, kind, task, arg = RECORD.unpack_from(data, offset)
+        offset += RECORD.size
+        if kind == TRACE_END:
+            break
+        records.append((time, kind, task, arg))
+    else:
+        print("warning: capture truncated before end record", file=sys.stderr)
+
+    return hz, names, records
+
+
+def unwrap(records):
+    # DWT_CYCCNT is 32 bits and wraps every ~107 s at 40 MHz
+    base = 0
+    last = None
+    for time, kind, task, arg in records:
+        if last is not None and time < last:
+            base += 1 << 32
+        last = time
+        yield base + time, kind, task, arg
+
+
+def convert(hz, names, records):
+    def name(task):
+        if task < len(names) and names[task]:
+            return names[task]
+        return "task %d" % task
+
+    events = [{"ph": "M", "pid": 1, "name": "process_name",
+               "args": {"name": "rtos"}}]
+    for task in range(len(names)):
+        events.append({"ph": "M", "pid": 1, "tid": task,
+                       "name": "thread_name", "args": {"name": name(task)}})
+
+    running = None
+    first = None
+    ts = 0.0
+    for cycles, kind, task, arg in unwrap(records):
+        if first is None:
+            first = cycles
+        ts = (cycles - first) * 1e6 / hz
+
+        if kind == TRACE_SWITCH:
+            if running is not None:
+                events.append({"ph": "E", "pid": 1, "tid": running, "ts": ts})
+            events.append({"ph": "B", "pid": 1, "tid": task, "ts": ts,
+                           "name": name(task),
+                           "args": {"from": name(arg)}})
+            running = task
+        elif kind == TRACE_SVC:
+            events.append({"ph": "i", "s": "t", "pid": 1, "tid": task,
+                           "ts": ts, "name": "svc %d" % arg})
+        elif kind == TRACE_WAKE:
+            events.append({"ph": "i", "s": "t", "pid": 1, "tid": task,
+                           "ts": ts, "name": "wake",
+                           "args": {"reason": WAKE_REASONS.get(arg, arg)}})
+        elif kind == TRACE_TICK:
+            events.append({"ph": "i", "s": "p", "pid": 1, "tid": task,
+                           "ts": ts, "name": "tick"})
+        elif kind == TRACE_ISR:
+            events.append({"ph": "i", "s": "p", "pid": 1, "tid": task,
+                           "ts": ts, "name": "isr %d" % arg})
+
+    if running is not None:
+        events.append({"ph": "E", "pid": 1, "tid": running, "ts": ts})
+
+    return {"traceEvents": events, "displayTimeUnit": "ns"}
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("capture", help="raw UART capture containing a dump")
+    parser.add_argument("-o", "--output", default="-",
+                        help="output JSON file (default stdout)")
+    args = parser.parse_args()
+
+    with open(args.capture, "rb") as f:
+        hz, names, records = parse(f.read())
+
+    trace = convert(hz, names, records)
+    if args.output == "-":
+        json.dump(trace, sys.stdout)
+    else:
+        with open(args.output, "w") as f:
+            json.dump(trace, f)
+    print("%d records converted" % len(records), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()